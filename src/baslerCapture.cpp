@@ -10,8 +10,18 @@
 #include <thread>
 #include <chrono>
 #include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <deque>
+#include <algorithm>
+#include <map>
 
 #include "baslerCapture.h"
+#include "bayerDemosaic.h"
+#include "monoUnpack.h"
+#include "frameSynchronizer.h"
+#include "threadTuning.h"
 
 const char cameraModelName[] = "daA1280-54um";
 
@@ -19,730 +29,3964 @@ using namespace Pylon;
 using namespace GenApi;
 
 static bool	g_bPylonAutoInitTerm = false;
-static std::mutex g_mu_Grab;
-static std::mutex g_mu_state;
 
 /****************************************
 
-ImageCache
+FrameAllocator
 
 *****************************************/
-class ImageCache
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag CvAccessFlag;
+#else
+typedef int CvAccessFlag;
+#endif
+
+// Lets a cv::Mat borrow a buffer it does not own (grab buffer or converted image).
+// The owner is kept alive until the last Mat sharing the buffer is released.
+class FrameAllocator : public cv::MatAllocator
 {
 public:
-	~ImageCache() {}
+	static cv::Mat wrap(int rows, int cols, int type, void *data, size_t step, const std::shared_ptr<void> &owner)
+	{
+		static FrameAllocator allocator;
+
+		cv::Mat mat(rows, cols, type, data, step);
+		cv::UMatData *u = new cv::UMatData(&allocator);
+		u->data = u->origdata = (uchar*)data;
+		u->size = step * rows;
+		u->refcount = 1;
+		u->userdata = new std::shared_ptr<void>(owner);
+		mat.u = u;
+		mat.allocator = &allocator;
+		return mat;
+	}
 
-	void setNumOfImage(int num)
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, CvAccessFlag flags, cv::UMatUsageFlags usageFlags) const
 	{
-		std::lock_guard<std::mutex> lk(m_mu_imageCacheNumOfImage);
-		m_NumImages = num;
+		// never allocates, cv::Mat::create falls back to the default allocator
+		return NULL;
 	}
-	int getNumOfImage()
+
+	bool allocate(cv::UMatData* data, CvAccessFlag accessflags, cv::UMatUsageFlags usageFlags) const
 	{
-		std::lock_guard<std::mutex> lk(m_mu_imageCacheNumOfImage);
-		return m_NumImages;
+		return false;
 	}
 
-	void recvMat(cv::Mat img)
+	void deallocate(cv::UMatData* u) const
 	{
-		m_vMat.push_back(img.clone());
-		// Increment image counter
-		m_currentImageCnt++;
+		if (u)
+		{
+			delete static_cast<std::shared_ptr<void>*>(u->userdata);
+			delete u;
+		}
+	}
+};
+
+/****************************************
 
-		if (m_currentImageCnt >= getNumOfImage())
+FramePool
+
+*****************************************/
+// Preallocated, aligned frame buffers of one size. A buffer goes back to the
+// pool when the last Mat using it is released. acquire() is only called from the
+// grab thread; buffers may be released from any thread, so the free list is a
+// lock-free stack with a single popper.
+class FramePool : public std::enable_shared_from_this<FramePool>
+{
+public:
+	FramePool(int rows, int cols, int type) 
+		: m_rows(rows), m_cols(cols), m_type(type), m_step(cols * CV_ELEM_SIZE(type)), m_pFree(NULL) {}
+	~FramePool()
+	{
+		for (int i = 0; i < m_vSlots.size(); ++i)
 		{
-			// emit signal;
-			std::unique_lock<std::mutex> lk(m_mu_imageCache);
-			m_is_condition_ready = true;
-			m_con_v_imageCache.notify_one();
+			cv::fastFree(m_vSlots[i]->pData);
+			delete m_vSlots[i];
 		}
 	}
-	
-	int getImages(std::vector<cv::Mat> &mats)
+
+	bool matches(int rows, int cols, int type) const
 	{
-		int status = 0;
-		std::unique_lock<std::mutex> lk(m_mu_imageCache);
+		return rows == m_rows && cols == m_cols && type == m_type;
+	}
 
-		bool bStatus = m_con_v_imageCache.wait_for(lk, std::chrono::seconds(10), [&]() {return m_is_condition_ready; });
-		if (bStatus == false)
+	int reserve(int numSlots)
+	{
+		std::lock_guard<std::mutex> lk(m_mu_reserve);
+		while (m_vSlots.size() < numSlots)
 		{
-			std::cerr << "get Images timeout!\n";
-			status = -1;
+			Slot *pSlot = new Slot;
+			pSlot->pData = cv::fastMalloc(m_step * m_rows);
+			m_vSlots.push_back(pSlot);
+			pushFree(pSlot);
 		}
+		return 0;
+	}
 
-		for (int i = 0; i < m_vMat.size(); ++i)
+	// Writes every free slot once from the grab thread, so the pages are mapped before the
+	// first frame and, with first-touch NUMA placement, local to that thread.
+	void prefault()
+	{
+		std::vector<cv::Mat> frames;
+		for (cv::Mat frame = acquire(); !frame.empty(); frame = acquire())
 		{
-			mats.push_back(m_vMat.at(i).clone());
+			frame.setTo(0);
+			frames.push_back(frame);
 		}
-		m_currentImageCnt = 0;
-		m_vMat.clear();
-		m_is_condition_ready = false;
-		return status;
+	}
+
+	// returns an empty Mat when all slots are in use
+	cv::Mat acquire()
+	{
+		Slot *pSlot = m_pFree.load(std::memory_order_acquire);
+		while (pSlot != NULL && !m_pFree.compare_exchange_weak(pSlot, pSlot->pNext, std::memory_order_acquire))
+		{
+		}
+		if (pSlot == NULL)
+		{
+			return cv::Mat();
+		}
+		std::shared_ptr<void> owner(pSlot->pData, SlotReturner(shared_from_this(), pSlot));
+		return FrameAllocator::wrap(m_rows, m_cols, m_type, pSlot->pData, m_step, owner);
 	}
 
 private:
+	struct Slot
+	{
+		void *pData;
+		Slot *pNext;
+	};
 
-	bool m_is_condition_ready = false;
-	std::mutex m_mu_imageCache;
-	std::condition_variable m_con_v_imageCache;
+	// keeps the pool alive while any of its slots is still referenced
+	struct SlotReturner
+	{
+		SlotReturner(const std::shared_ptr<FramePool> &pPool, Slot *pSlot) : m_pPool(pPool), m_pSlot(pSlot) {}
+		void operator()(void *)
+		{
+			m_pPool->pushFree(m_pSlot);
+		}
+		std::shared_ptr<FramePool> m_pPool;
+		Slot *m_pSlot;
+	};
 
-	std::mutex m_mu_grab;
-	std::mutex m_mu_imageCacheNumOfImage;
+	void pushFree(Slot *pSlot)
+	{
+		Slot *pHead = m_pFree.load(std::memory_order_relaxed);
+		do
+		{
+			pSlot->pNext = pHead;
+		} while (!m_pFree.compare_exchange_weak(pHead, pSlot, std::memory_order_release, std::memory_order_relaxed));
+	}
 
-	unsigned int m_NumImages= 1;
-	unsigned int m_currentImageCnt = 0;
-	std::vector<cv::Mat> m_vMat;
+private:
+	int m_rows;
+	int m_cols;
+	int m_type;
+	size_t m_step;
+
+	std::mutex m_mu_reserve;
+	std::vector<Slot*> m_vSlots;
+	std::atomic<Slot*> m_pFree;
 };
 
 /****************************************
 
-ImageEventHandler
+FrameQueue
 
 *****************************************/
-class ImageEventHandler : public  Pylon::CImageEventHandler
+// Bounded single-producer/single-consumer queue. push() is only called from the
+// grab thread, pop() only from the thread currently owning the camera.
+class FrameQueue
 {
 public:
-	ImageEventHandler(){}
-	~ImageEventHandler() {}
+	FrameQueue(int capacity) : m_vSlots(capacity + 1), m_head(0), m_tail(0) {}
 
-	int setColor(bool bIsColor)
+	int capacity() const
 	{
-		m_bIsColor = bIsColor;
-		if (m_bIsColor)
-		{
-			m_ImageConverter.OutputPixelFormat = Pylon::PixelType_RGB8packed;
-		}
-		else
-		{
-			m_ImageConverter.OutputPixelFormat = Pylon::PixelType_Mono8;
-		}
-		return 0;
+		return (int)m_vSlots.size() - 1;
 	}
 
-	int setCache(ImageCache *pCache)
+	int size() const
 	{
-		m_pCache = pCache;
-		return 0;
+		size_t head = m_head.load(std::memory_order_acquire);
+		size_t tail = m_tail.load(std::memory_order_acquire);
+		return (int)((tail + m_vSlots.size() - head) % m_vSlots.size());
 	}
 
-	void OnImageGrabbed(Pylon::CInstantCamera& camera, const Pylon::CGrabResultPtr& ptrGrabResult)
+	bool push(const Frame &frame)
 	{
-		//std::cout << "Image Grabbed event..." << "\n";
-
-		if (ptrGrabResult->GrabSucceeded())
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) % m_vSlots.size();
+		if (next == m_head.load(std::memory_order_acquire))
 		{
-			//std::cout << "OnImageGrabbed Succeed" << "\n";
-			uint8_t *pImageBuffer = (uint8_t *)ptrGrabResult->GetBuffer();
-			if (pImageBuffer != NULL)
-			{
-				//std::cout << "pImageBuffer ok" << "\n";
-				uint32_t width = ptrGrabResult->GetWidth();
-				uint32_t height = ptrGrabResult->GetHeight();
-				//std::cout << "Grabbed image " << ", width = " << width << ", height = " << height << "\n";
-				//std::cout << "getting image from camera buffer to ram..." << "\n";
-			
-				if (m_bIsColor)
-				{
-					//std::cout << "form image" << "\n";
-					Pylon::CPylonImage pylonImage;
-					m_ImageConverter.Convert(pylonImage, ptrGrabResult);
-					cv::Mat imageRGB = cv::Mat(height, width, CV_8UC3, (uint8_t*)pylonImage.GetBuffer());
-					cv::Mat outMat;
-					if (!imageRGB.empty() && imageRGB.channels() == 3)
-					{
-						cv::Mat imageBGR;
-						//std::cout << "convert color" << "\n";
-						try
-						{
-							cv::cvtColor(imageRGB, imageBGR, cv::COLOR_RGB2BGR);
-							outMat = imageBGR;
-							//outMat = imageRGB.clone();
-						}
-						catch (...)
-						{
-							std::cerr << "catch at cv::cvtColor(imageRGB, imageBGR, cv::COLOR_RGB2BGR)" << "\n";
-							outMat = cv::Mat();
-						}
-					}
-					if (m_pCache)
-					{
-						m_pCache->recvMat(outMat);
-					}
-				}
-				else
-				{
-					Pylon::CPylonImage pylonImage;
-					m_ImageConverter.Convert(pylonImage, ptrGrabResult);
-					cv::Mat imageBW = cv::Mat(height, width, CV_8UC1, (uint8_t*)pylonImage.GetBuffer());
-					cv::Mat outMat = imageBW;
-					if (m_pCache)
-					{
-						m_pCache->recvMat(outMat);
-					}
-				}
-				
-			}
-			else
-			{
-				std::cout << "ERROR pImageBuffer NULL" << "\n";
-			}
+			return false;
 		}
-		else
+		m_vSlots[tail] = frame;
+		m_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(Frame &frame)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
 		{
-			std::cout << "OnImageGrabbed Fail" << "\n";
-			uint32_t nError = ptrGrabResult->GetErrorCode();
-			Pylon::String_t strError = ptrGrabResult->GetErrorDescription();
-			std::cout << "ERROR OnImageGrabbed" << nError << "    " << strError << "\n";
+			return false;
 		}
+		frame = m_vSlots[head];
+		m_vSlots[head] = Frame();
+		m_head.store((head + 1) % m_vSlots.size(), std::memory_order_release);
+		return true;
 	}
+
 private:
-	bool m_bIsColor = false;
-	ImageCache* m_pCache = NULL;
-	Pylon::CImageFormatConverter m_ImageConverter;
+	std::vector<Frame> m_vSlots;
+	std::atomic<size_t> m_head;
+	std::atomic<size_t> m_tail;
 };
 
 /****************************************
 
-baslerCam
+LatestFrame
 
 *****************************************/
-class baslerCam
+// Keeps only the newest frame, as a lock-free triple buffer. publish() is called
+// from the grab thread, fetch() from one consumer at a time.
+class LatestFrame
 {
 public:
-	baslerCam() {};
-	~baslerCam();
-	int init(CDeviceInfo info);
-	std::string getSerial();
-	int configurateExposure(float exposureTime); // microsec
-	int start();
-	int stop();
-	int readyHWTrig(int numOfTrig);
-	int getHWTrigImgs(std::vector<cv::Mat> &imgs);
-	int ExecuteSWTrig(cv::Mat& img);
-private:
-	int OpenDevice(CDeviceInfo info);
-	int CloseDevice();
-private:
+	LatestFrame() : m_back(0), m_middle(1), m_front(2) {}
 
-	int m_UseDevIdx = 0;
-	std::string m_CamSN;
-	Pylon::CInstantCamera m_InstantCamera;
-	ImageEventHandler m_imageEventHandler;
-	ImageCache m_Cache;
-	bool m_IsHWtriggerRunning = false;
-};
+	void publish(const Frame &frame)
+	{
+		m_slots[m_back] = frame;
+		int prev = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+		m_back = prev & INDEX_MASK;
+		// a frame the consumer never saw, give its buffer back right away
+		m_slots[m_back] = Frame();
+	}
 
-int baslerCam::init(CDeviceInfo info)
-{
-	int status = 0;
-	try
+	// newest frame, or the previous one again when nothing new arrived
+	bool fetch(Frame &frame)
 	{
-		status = OpenDevice(info);
-		if (status != 0)
+		if (m_middle.load(std::memory_order_acquire) & FRESH)
 		{
-			std::cerr << "init fail.\n";
-			return -1;
+			m_slots[m_front] = Frame();
+			int prev = m_middle.exchange(m_front, std::memory_order_acq_rel);
+			m_front = prev & INDEX_MASK;
 		}
+		frame = m_slots[m_front];
+		return !frame.image.empty();
 	}
-	catch (GenICam::GenericException &e)
+
+	// consumer: forget frames from an earlier session
+	void reset()
 	{
-		std::cerr << "init fail. \n";
-		std::cerr << e.what();
-		return -1;
+		Frame stale;
+		fetch(stale);
+		m_slots[m_front] = Frame();
 	}
 
-	return 0;
-}
+private:
+	static const int INDEX_MASK = 3;
+	static const int FRESH = 4;
 
-std::string baslerCam::getSerial()
-{
-	return m_CamSN;
-}
+	Frame m_slots[3];
+	int m_back;                // owned by the producer
+	std::atomic<int> m_middle; // index of the handed over slot | FRESH
+	int m_front;               // owned by the consumer
+};
 
-baslerCam::~baslerCam()
-{
-	CloseDevice();
-}
+/****************************************
 
-int baslerCam::OpenDevice(CDeviceInfo info)
+CaptureDispatcher
+
+*****************************************/
+// Completes asynchronous captures on a single thread, however many are outstanding.
+// A job is polled when a cache signals a new frame, and a last time once its deadline passed.
+class CaptureDispatcher
 {
-	//  prepare m_InstantCamera
-	if (m_InstantCamera.IsPylonDeviceAttached())
+public:
+	// returns true when the job is finished and can be dropped
+	typedef std::function<bool(bool bTimedOut)> Job;
+
+	CaptureDispatcher() : m_numPending(0) {}
+	~CaptureDispatcher()
 	{
-		m_InstantCamera.DetachDevice();
-		m_InstantCamera.DestroyDevice();
+		stop();
 	}
 
-	m_InstantCamera.Attach(CTlFactory::GetInstance().CreateDevice(info));
-	m_InstantCamera.Open();
-
-	std::string camModelName = std::string( CStringPtr(m_InstantCamera.GetNodeMap().GetNode("DeviceModelName"))->GetValue().c_str());
-	std::cout << "camModelName = " << camModelName << "\n";
-
-	//  assign sn
-	m_CamSN = info.GetSerialNumber().c_str();
+	// the thread is only started by the first job
+	void post(const Job &job, std::chrono::steady_clock::time_point deadline)
+	{
+		std::lock_guard<std::mutex> lk(m_mu);
+		if (!m_thread.joinable())
+		{
+			m_bQuit = false;
+			m_thread = std::thread(&CaptureDispatcher::run, this);
+		}
+		Pending pending = { job, deadline };
+		m_jobs.push_back(pending);
+		m_numPending.fetch_add(1);
+		m_bSignaled = true;
+		m_con_v.notify_one();
+	}
 
-	// default trigger mode since it does not waste resources
-	// Set trigger and expose
-	CEnumerationPtr triggerMode(m_InstantCamera.GetNodeMap().GetNode("TriggerMode"));
-	triggerMode->FromString("On");
+	// any thread, no lock taken while nothing is pending.
+	// The caller must order its frame hand-over before this call with a seq_cst fence.
+	void notify()
+	{
+		if (m_numPending.load(std::memory_order_relaxed) == 0)
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> lk(m_mu);
+		m_bSignaled = true;
+		m_con_v.notify_one();
+	}
 
-	// Set color
-	bool bIsColor = false;
-	const char * pchar = camModelName.c_str();
-	if ('m' == pchar[camModelName.size() - 1])
+	// jobs still pending are finished as timed out
+	void stop()
 	{
-		std::cout << "it is mono camera" << "\n";
-		bIsColor = false;
+		{
+			std::lock_guard<std::mutex> lk(m_mu);
+			m_bQuit = true;
+			m_con_v.notify_one();
+		}
+		if (m_thread.joinable())
+		{
+			m_thread.join();
+		}
 	}
-	else if ('c' == pchar[camModelName.size() - 1])
+
+private:
+	struct Pending
 	{
-		std::cout << "it is RGB camera = " << "\n";
-		bIsColor = true;
+		Job job;
+		std::chrono::steady_clock::time_point deadline;
+	};
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lk(m_mu);
+		while (true)
+		{
+			if (!m_bSignaled && !m_bQuit)
+			{
+				if (m_jobs.empty())
+				{
+					m_con_v.wait(lk);
+				}
+				else
+				{
+					std::chrono::steady_clock::time_point deadline = m_jobs[0].deadline;
+					for (int i = 1; i < m_jobs.size(); ++i)
+					{
+						deadline = std::min(deadline, m_jobs[i].deadline);
+					}
+					m_con_v.wait_until(lk, deadline);
+				}
+			}
+			bool bQuit = m_bQuit;
+			m_bSignaled = false;
+
+			// jobs run without the lock, post() may add new ones meanwhile
+			std::vector<Pending> jobs;
+			jobs.swap(m_jobs);
+			lk.unlock();
+			// pairs with the fence before notify(), a frame is either seen here or signals again
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			std::vector<Pending> unfinished;
+			int numFinished = 0;
+			for (int i = 0; i < jobs.size(); ++i)
+			{
+				if (jobs[i].job(bQuit || now >= jobs[i].deadline))
+				{
+					numFinished++;
+				}
+				else
+				{
+					unfinished.push_back(jobs[i]);
+				}
+			}
+			lk.lock();
+			m_jobs.insert(m_jobs.end(), unfinished.begin(), unfinished.end());
+			m_numPending.fetch_sub(numFinished);
+			if (bQuit && m_jobs.empty())
+			{
+				return;
+			}
+		}
 	}
 
-	// Set software trigger as default. SHould not use func to avoid the state check
-	m_Cache.setNumOfImage(1);
-	CEnumerationPtr triggerSource(m_InstantCamera.GetNodeMap().GetNode("TriggerSource"));
-	triggerSource->FromString("Software");
+private:
+	std::mutex m_mu;
+	std::condition_variable m_con_v;
+	std::vector<Pending> m_jobs;
+	std::atomic<int> m_numPending;
+	bool m_bSignaled = false;
+	bool m_bQuit = false;
+	std::thread m_thread;
+};
 
-	// set ImageEventHandler 
-	m_InstantCamera.RegisterImageEventHandler(&m_imageEventHandler, RegistrationMode_Append, Cleanup_None);
-	m_imageEventHandler.setCache(&m_Cache);
-	m_imageEventHandler.setColor(bIsColor);
-	
+/****************************************
 
-	return 0;
-}
+ImageCache
 
-int baslerCam::configurateExposure(float time)
+*****************************************/
+// Hands frames from the grab thread to one consumer. The grab thread never takes
+// a lock unless the consumer is blocked in getImages() or it overwrites a frame.
+// cancel() fails every wait on frames armed before it, including waits not yet started.
+class ImageCache
 {
-	CFloatPtr exposureTime(m_InstantCamera.GetNodeMap().GetNode("ExposureTime"));
-	exposureTime->SetValue(time);
-	return 0;
-}
+public:
+	static const int DEFAULT_CAPACITY = 8;
+	static const int SPARE_SLOTS = 4; // slots for frames still held by the consumer
+	static const int DEFAULT_TIMEOUT_MS = 10000;
 
+	ImageCache() : m_pQueue(new FrameQueue(DEFAULT_CAPACITY)), m_NumImages(1), m_bArmed(false), m_bWaiting(false), m_numDropped(0),
+		m_timeoutMs(DEFAULT_TIMEOUT_MS), m_cancelGen(0), m_bLatestOnly(false), m_bOverwriteOldest(false) {}
+	~ImageCache() {}
 
-int baslerCam::CloseDevice()
-{
-	if (m_InstantCamera.IsOpen())
+	int capacity()
 	{
-		m_InstantCamera.Close();
+		return m_pQueue->capacity();
 	}
 
-	m_InstantCamera.DeregisterImageEventHandler(&m_imageEventHandler);
-		
-
-	if (m_InstantCamera.IsPylonDeviceAttached())
+	// frames queued and not yet taken, any thread
+	int size()
 	{
-		m_InstantCamera.DetachDevice();
-		m_InstantCamera.DestroyDevice();
+		std::lock_guard<std::mutex> lk(m_mu_imageCache);
+		return m_pQueue->size();
 	}
 
-	return 0;
-}
+	// signalled for every queued frame, so asynchronous captures need no waiting thread
+	int setDispatcher(CaptureDispatcher *pDispatcher)
+	{
+		m_pDispatcher = pDispatcher;
+		return 0;
+	}
+
+	// deadline of getImages() and of asynchronous captures, any thread
+	int setTimeout(int timeoutMs)
+	{
+		m_timeoutMs.store(timeoutMs);
+		return 0;
+	}
+
+	int getTimeout()
+	{
+		return m_timeoutMs.load();
+	}
+
+	// any thread: wakes the blocked consumer, and the dispatcher for asynchronous captures
+	void cancel()
+	{
+		{
+			std::lock_guard<std::mutex> lk(m_mu_imageCache);
+			m_cancelGen.fetch_add(1);
+			m_con_v_imageCache.notify_all();
+		}
+		if (m_pDispatcher != NULL)
+		{
+			m_pDispatcher->notify();
+		}
+	}
+
+	// consumer: cancel() was called since the last arm()
+	bool isCancelled()
+	{
+		return m_cancelGen.load() != m_armGen;
+	}
+
+	// (re)creates the frame pool for the given frame size. Camera must not be grabbing.
+	int allocate(int rows, int cols, int type)
+	{
+		if (!m_pPool || !m_pPool->matches(rows, cols, type))
+		{
+			m_pPool = std::make_shared<FramePool>(rows, cols, type);
+		}
+		m_pPool->reserve(capacity() + SPARE_SLOTS);
+		return 0;
+	}
+
+	// grows queue and pool so that num frames can be cached at once.
+	// Growing the queue requires the camera not to be grabbing.
+	int reserve(int num)
+	{
+		if (num > capacity())
+		{
+			// size() may read the queue from another thread
+			std::unique_ptr<FrameQueue> pQueue(new FrameQueue(num));
+			std::lock_guard<std::mutex> lk(m_mu_imageCache);
+			m_pQueue.swap(pQueue);
+		}
+		if (m_pPool)
+		{
+			m_pPool->reserve(num + SPARE_SLOTS);
+		}
+		return 0;
+	}
+
+	// grab thread
+	void prefault()
+	{
+		if (m_pPool)
+		{
+			m_pPool->prefault();
+		}
+	}
+
+	// frame buffer to fill on the grab thread, taken from the pool if possible
+	cv::Mat acquireFrame(int rows, int cols, int type)
+	{
+		if (m_pPool && m_pPool->matches(rows, cols, type))
+		{
+			cv::Mat frame = m_pPool->acquire();
+			if (!frame.empty())
+			{
+				return frame;
+			}
+		}
+		return cv::Mat(rows, cols, type);
+	}
+
+	// grab thread
+	void recvFrame(const Frame &frame)
+	{
+		if (m_bLatestOnly.load(std::memory_order_acquire))
+		{
+			m_latest.publish(frame);
+			return;
+		}
+		if (!m_bArmed.load(std::memory_order_acquire))
+		{
+			// nobody asked for this frame
+			return;
+		}
+		if (!push(frame))
+		{
+			if (!m_bOverwriteOldest.load(std::memory_order_acquire))
+			{
+				// a stream the consumer falls behind on would log every frame, once per arm is enough
+				if (m_numDropped.fetch_add(1, std::memory_order_relaxed) == 0)
+				{
+					std::cerr << "image cache full, frame dropped.\n";
+				}
+				return;
+			}
+			overwriteOldest(frame);
+		}
+
+		// pairs with the fence in getImages, one side always sees the other
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_bWaiting.load(std::memory_order_relaxed))
+		{
+			// emit signal;
+			std::lock_guard<std::mutex> lk(m_mu_imageCache);
+			m_con_v_imageCache.notify_one();
+		}
+		if (m_pDispatcher != NULL)
+		{
+			m_pDispatcher->notify();
+		}
+	}
+
+	// consumer: drop leftovers and start collecting num frames
+	void arm(int num)
+	{
+		std::vector<Frame> stale;
+		popImages(capacity(), stale);
+		m_NumImages.store(num);
+		m_numDropped.store(0, std::memory_order_relaxed);
+		m_armGen = m_cancelGen.load();
+		m_bArmed.store(true, std::memory_order_release);
+	}
+
+	// frames the grab thread could not queue since arm()
+	int64_t getNumDropped()
+	{
+		return m_numDropped.load(std::memory_order_relaxed);
+	}
+
+	void disarm()
+	{
+		m_bArmed.store(false, std::memory_order_release);
+	}
+
+	// consumer: keep only the newest frame instead of queueing
+	void setLatestOnly(bool bLatestOnly)
+	{
+		m_latest.reset();
+		m_bLatestOnly.store(bLatestOnly, std::memory_order_release);
+	}
+
+	int getLatest(Frame &frame)
+	{
+		return m_latest.fetch(frame) ? 0 : -1;
+	}
+
+	// any thread: a full queue drops its oldest frame for a new one instead of the new one
+	void setOverwriteOldest(bool bOverwrite)
+	{
+		m_bOverwriteOldest.store(bOverwrite, std::memory_order_release);
+	}
+	
+	// deadline of a wait starting now, see setTimeout()
+	std::chrono::steady_clock::time_point getDeadline()
+	{
+		return std::chrono::steady_clock::now() + std::chrono::milliseconds(getTimeout());
+	}
+
+	// 0, CAPTURE_TIMEOUT or CAPTURE_CANCELLED. The frames that did arrive are taken in any case.
+	int getImages(std::vector<Frame> &frames, std::chrono::steady_clock::time_point deadline)
+	{
+		int numImages = m_NumImages.load();
+		int status = waitImages(numImages, deadline);
+		if (status == baslerCaptureItf::CAPTURE_TIMEOUT)
+		{
+			std::cerr << "get Images timeout!\n";
+		}
+		else if (status == baslerCaptureItf::CAPTURE_CANCELLED)
+		{
+			std::cerr << "get Images cancelled.\n";
+		}
+
+		popImages(numImages, frames);
+		return status;
+	}
+
+	// consumer, streaming: waits until deadline for a first frame, then takes up to
+	// maxNum queued frames (all of them for maxNum <= 0).
+	// 0 when frames were taken, 1 when none arrived in time, CAPTURE_CANCELLED after cancel().
+	int getStreamImages(std::vector<Frame> &frames, int maxNum, std::chrono::steady_clock::time_point deadline)
+	{
+		int status = waitImages(1, deadline);
+		popImages(maxNum > 0 ? maxNum : m_pQueue->capacity(), frames);
+		return status == baslerCaptureItf::CAPTURE_TIMEOUT ? 1 : status;
+	}
+
+	// consumer, non-blocking: 0 when all armed frames arrived and were taken, 1 otherwise.
+	// bTakePartial takes whatever has arrived so far, e.g. after a timeout.
+	int tryGetImages(std::vector<Frame> &frames, bool bTakePartial)
+	{
+		int numImages = m_NumImages.load();
+		if (m_pQueue->size() >= numImages)
+		{
+			popImages(numImages, frames);
+			return 0;
+		}
+		if (bTakePartial)
+		{
+			popImages(numImages, frames);
+		}
+		return 1;
+	}
+
+private:
+	// frames that arrived win over a cancel() at the same time
+	int waitImages(int numImages, std::chrono::steady_clock::time_point deadline)
+	{
+		std::unique_lock<std::mutex> lk(m_mu_imageCache);
+		m_bWaiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_con_v_imageCache.wait_until(lk, deadline, [&]() {return m_pQueue->size() >= numImages || isCancelled(); });
+		m_bWaiting.store(false, std::memory_order_relaxed);
+		if (m_pQueue->size() >= numImages)
+		{
+			return 0;
+		}
+		return isCancelled() ? baslerCaptureItf::CAPTURE_CANCELLED : baslerCaptureItf::CAPTURE_TIMEOUT;
+	}
+
+	// frames own their buffers, hand over the headers only.
+	// The grab thread pops too in overwriteOldest(), the lock keeps the queue single consumer.
+	void popImages(int numImages, std::vector<Frame> &frames)
+	{
+		std::lock_guard<std::mutex> lk(m_mu_imageCache);
+		Frame frame;
+		for (int i = 0; i < numImages && m_pQueue->pop(frame); ++i)
+		{
+			frames.push_back(frame);
+		}
+	}
+
+	// grab thread, queue full. The consumer may have made room meanwhile, then nothing is dropped.
+	// grab thread: the queue may have grown for an earlier arm(), it holds as many frames as armed
+	bool push(const Frame &frame)
+	{
+		return m_pQueue->size() < m_NumImages.load(std::memory_order_relaxed) && m_pQueue->push(frame);
+	}
+
+	void overwriteOldest(const Frame &frame)
+	{
+		Frame oldest;
+		{
+			std::lock_guard<std::mutex> lk(m_mu_imageCache);
+			if (push(frame))
+			{
+				return;
+			}
+			m_pQueue->pop(oldest);
+			m_pQueue->push(frame);
+		}
+		m_numDropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+private:
+	std::mutex m_mu_imageCache;
+	std::condition_variable m_con_v_imageCache;
+
+	std::unique_ptr<FrameQueue> m_pQueue;
+	std::shared_ptr<FramePool> m_pPool;
+
+	std::atomic<int> m_NumImages;
+	std::atomic<bool> m_bArmed;
+	std::atomic<bool> m_bWaiting;
+	std::atomic<int64_t> m_numDropped;
+
+	std::atomic<int> m_timeoutMs;
+	std::atomic<int> m_cancelGen;
+	int m_armGen = 0; // m_cancelGen as of the last arm(), consumer only
+
+	LatestFrame m_latest;
+	std::atomic<bool> m_bLatestOnly;
+	std::atomic<bool> m_bOverwriteOldest;
+
+	CaptureDispatcher *m_pDispatcher = NULL;
+};
+
+/****************************************
+
+FrameSubscribers
+
+*****************************************/
+// Queue and thread of a DISPATCH_WORKER subscription. When the subscriber falls
+// behind, the oldest queued frame is dropped so latency stays bounded.
+class FrameWorker
+{
+public:
+	static const int MAX_QUEUED = 4;
+
+	FrameWorker(const std::function<void(const Frame &)> &callback) : m_pState(std::make_shared<State>())
+	{
+		m_pState->callback = callback;
+		m_thread = std::thread(&FrameWorker::run, m_pState);
+	}
+	~FrameWorker()
+	{
+		{
+			std::lock_guard<std::mutex> lk(m_pState->mu);
+			m_pState->bQuit = true;
+			m_pState->con_v.notify_one();
+		}
+		// unsubscribing from inside the own callback must not wait for itself,
+		// the thread keeps the state alive until it leaves
+		if (m_thread.get_id() == std::this_thread::get_id())
+		{
+			m_thread.detach();
+		}
+		else
+		{
+			m_thread.join();
+		}
+	}
+
+	void push(const Frame &frame)
+	{
+		std::lock_guard<std::mutex> lk(m_pState->mu);
+		if (m_pState->queue.size() >= MAX_QUEUED)
+		{
+			m_pState->queue.pop_front();
+			m_pState->numDropped++;
+		}
+		m_pState->queue.push_back(frame);
+		m_pState->con_v.notify_one();
+	}
+
+private:
+	struct State
+	{
+		std::function<void(const Frame &)> callback;
+		std::mutex mu;
+		std::condition_variable con_v;
+		std::deque<Frame> queue;
+		int numDropped = 0;
+		bool bQuit = false;
+	};
+
+	static void run(std::shared_ptr<State> pState)
+	{
+		std::unique_lock<std::mutex> lk(pState->mu);
+		while (true)
+		{
+			pState->con_v.wait(lk, [&]() { return pState->bQuit || !pState->queue.empty(); });
+			if (pState->bQuit)
+			{
+				return;
+			}
+			Frame frame = pState->queue.front();
+			pState->queue.pop_front();
+			int numDropped = pState->numDropped;
+			pState->numDropped = 0;
+			lk.unlock();
+
+			if (numDropped > 0)
+			{
+				std::cerr << "frame subscriber too slow, " << numDropped << " frames dropped.\n";
+			}
+			try
+			{
+				pState->callback(frame);
+			}
+			catch (std::exception &e)
+			{
+				std::cerr << "catch at frame callback: " << e.what() << "\n";
+			}
+			frame = Frame();
+			lk.lock();
+		}
+	}
+
+private:
+	std::shared_ptr<State> m_pState;
+	std::thread m_thread;
+};
+
+// Subscriptions of one camera. The grab thread reads a snapshot of the list and
+// never waits for subscribe() / unsubscribe().
+class FrameSubscribers
+{
+public:
+	FrameSubscribers() : m_numSubscriptions(0) {}
+
+	int add(int id, const std::function<void(const Frame &)> &callback, int dispatch)
+	{
+		Subscription sub;
+		sub.id = id;
+		sub.callback = callback;
+		if (dispatch == baslerCaptureItf::DISPATCH_WORKER)
+		{
+			sub.pWorker = std::make_shared<FrameWorker>(callback);
+		}
+
+		std::lock_guard<std::mutex> lk(m_mu);
+		std::shared_ptr<std::vector<Subscription> > pList = std::make_shared<std::vector<Subscription> >(*m_pList);
+		pList->push_back(sub);
+		publish(pList);
+		return 0;
+	}
+
+	// -1 if the id is not subscribed here
+	int remove(int id)
+	{
+		std::shared_ptr<FrameWorker> pWorker;
+		{
+			std::lock_guard<std::mutex> lk(m_mu);
+			std::shared_ptr<std::vector<Subscription> > pList = std::make_shared<std::vector<Subscription> >();
+			bool bFound = false;
+			for (int i = 0; i < m_pList->size(); ++i)
+			{
+				if ((*m_pList)[i].id == id)
+				{
+					pWorker = (*m_pList)[i].pWorker;
+					bFound = true;
+				}
+				else
+				{
+					pList->push_back((*m_pList)[i]);
+				}
+			}
+			if (!bFound)
+			{
+				return -1;
+			}
+			publish(pList);
+		}
+		// pWorker is released here, outside the lock: stopping it waits for a running
+		// callback, which may itself be calling subscribe() / unsubscribe()
+		return 0;
+	}
+
+	// grab thread
+	void deliver(const Frame &frame)
+	{
+		if (m_numSubscriptions.load(std::memory_order_acquire) == 0 || frame.image.empty())
+		{
+			return;
+		}
+		std::shared_ptr<const std::vector<Subscription> > pList = std::atomic_load(&m_pSnapshot);
+		for (int i = 0; i < pList->size(); ++i)
+		{
+			const Subscription &sub = (*pList)[i];
+			if (sub.pWorker)
+			{
+				sub.pWorker->push(frame);
+				continue;
+			}
+			try
+			{
+				sub.callback(frame);
+			}
+			catch (std::exception &e)
+			{
+				std::cerr << "catch at frame callback: " << e.what() << "\n";
+			}
+		}
+	}
+
+private:
+	struct Subscription
+	{
+		int id;
+		std::function<void(const Frame &)> callback;
+		std::shared_ptr<FrameWorker> pWorker; // NULL for DISPATCH_INLINE
+	};
+
+	// m_mu held
+	void publish(const std::shared_ptr<std::vector<Subscription> > &pList)
+	{
+		m_pList = pList;
+		std::atomic_store(&m_pSnapshot, std::shared_ptr<const std::vector<Subscription> >(pList));
+		m_numSubscriptions.store((int)pList->size(), std::memory_order_release);
+	}
+
+private:
+	std::mutex m_mu; // serializes writers
+	std::shared_ptr<std::vector<Subscription> > m_pList = std::make_shared<std::vector<Subscription> >();
+	std::shared_ptr<const std::vector<Subscription> > m_pSnapshot = m_pList;
+	std::atomic<int> m_numSubscriptions;
+};
+
+/****************************************
+
+ImageEventHandler
+
+*****************************************/
+class ImageEventHandler : public  Pylon::CImageEventHandler
+{
+public:
+	ImageEventHandler() : m_pNumLentBuffers(std::make_shared<std::atomic<int> >(0)) {}
+	~ImageEventHandler() {}
+
+	int setColor(bool bIsColor)
+	{
+		m_bIsColor = bIsColor;
+		if (m_bIsColor)
+		{
+			m_ImageConverter.OutputPixelFormat = Pylon::PixelType_BGR8packed;
+		}
+		else
+		{
+			m_ImageConverter.OutputPixelFormat = Pylon::PixelType_Mono8;
+		}
+		return 0;
+	}
+
+	int setCache(ImageCache *pCache)
+	{
+		m_pCache = pCache;
+		return 0;
+	}
+
+	FrameSubscribers &subscribers()
+	{
+		return m_subscribers;
+	}
+
+	// identity stamped on every frame
+	int setSource(const std::string &camSN, int camIdx)
+	{
+		m_camSN = camSN;
+		m_camIdx = camIdx;
+		return 0;
+	}
+
+	// exposure the camera was last set to, reported with each frame
+	int setExposureTime(double exposureTime)
+	{
+		m_exposureTime = exposureTime;
+		return 0;
+	}
+
+	// DEMOSAIC_PYLON leaves Bayer frames to the pylon converter, the other modes use BayerDemosaic.
+	// Takes effect on the next frame, the frame pool follows on the next start().
+	int setDemosaicMode(int mode)
+	{
+		m_demosaicMode = mode;
+		return 0;
+	}
+
+	// size and type of the frames delivered for a pixel format, used to size the frame pool
+	int getFrameFormat(const std::string &pixelFormat, int width, int height, int &rows, int &cols, int &type)
+	{
+		rows = height;
+		cols = width;
+		type = m_bIsColor ? CV_8UC3 : CV_8UC1;
+		if (!m_bIsColor && (pixelFormat == "Mono10" || pixelFormat == "Mono12" || pixelFormat == "Mono16"
+			|| pixelFormat == "Mono10p" || pixelFormat == "Mono12p"))
+		{
+			type = CV_16UC1;
+		}
+		bool bBayer8 = pixelFormat.size() == 8 && pixelFormat.compare(0, 5, "Bayer") == 0 && pixelFormat[7] == '8';
+		if (m_bIsColor && bBayer8 && m_demosaicMode == baslerCaptureItf::DEMOSAIC_SUPERPIXEL)
+		{
+			BayerDemosaic::getOutputSize(BayerDemosaic::MODE_SUPERPIXEL, width, height, cols, rows);
+		}
+		return 0;
+	}
+
+	// number of grab buffers that may be handed out to callers at the same time.
+	// Must stay below MaxNumBuffer, otherwise pylon runs out of buffers to requeue.
+	int setMaxLentBuffers(int num)
+	{
+		m_nMaxLentBuffers = num;
+		return 0;
+	}
+
+	int getNumLentBuffers()
+	{
+		return m_pNumLentBuffers->load();
+	}
+
+	// CHUNK_* values read from every frame, set while the camera is not grabbing
+	int setChunks(int chunks)
+	{
+		m_chunks = chunks;
+		return 0;
+	}
+
+	// the chunk nodemaps belong to the grab buffers, which are freed when grabbing stops
+	void resetChunkNodes()
+	{
+		m_chunkNodes.clear();
+	}
+
+	void OnImageGrabbed(Pylon::CInstantCamera& camera, const Pylon::CGrabResultPtr& ptrGrabResult)
+	{
+		//std::cout << "Image Grabbed event..." << "\n";
+		if (m_pCache == NULL)
+		{
+			return;
+		}
+		std::chrono::steady_clock::time_point hostTime = std::chrono::steady_clock::now();
+
+		if (ptrGrabResult->GrabSucceeded())
+		{
+			//std::cout << "OnImageGrabbed Succeed" << "\n";
+			uint8_t *pImageBuffer = (uint8_t *)ptrGrabResult->GetBuffer();
+			if (pImageBuffer != NULL)
+			{
+				//std::cout << "pImageBuffer ok" << "\n";
+				uint32_t width = ptrGrabResult->GetWidth();
+				uint32_t height = ptrGrabResult->GetHeight();
+				//std::cout << "Grabbed image " << ", width = " << width << ", height = " << height << "\n";
+				//std::cout << "getting image from camera buffer to ram..." << "\n";
+			
+				int pattern = bayerPattern(ptrGrabResult->GetPixelType());
+				int demosaicMode = m_demosaicMode;
+				if (m_bIsColor && pattern >= 0 && demosaicMode != baslerCaptureItf::DEMOSAIC_PYLON)
+				{
+					int mode = demosaicMode == baslerCaptureItf::DEMOSAIC_SUPERPIXEL ? BayerDemosaic::MODE_SUPERPIXEL : BayerDemosaic::MODE_BILINEAR;
+					int outWidth = 0;
+					int outHeight = 0;
+					BayerDemosaic::getOutputSize(mode, width, height, outWidth, outHeight);
+					cv::Mat outMat = m_pCache->acquireFrame(outHeight, outWidth, CV_8UC3);
+					size_t step = width + ptrGrabResult->GetPaddingX();
+					if (BayerDemosaic::run(pImageBuffer, step, width, height, pattern, outMat.data, outMat.step, mode) != 0)
+					{
+						std::cerr << "BayerDemosaic fail, width = " << width << ", height = " << height << "\n";
+						outMat = cv::Mat();
+					}
+					deliver(outMat, ptrGrabResult, hostTime);
+				}
+				else if (m_bIsColor)
+				{
+					//std::cout << "form image" << "\n";
+					// raw Bayer to BGR in one pass, written straight into the pool slot
+					cv::Mat outMat = m_pCache->acquireFrame(height, width, CV_8UC3);
+					try
+					{
+						m_ImageConverter.Convert(outMat.data, outMat.total() * outMat.elemSize(), ptrGrabResult);
+					}
+					catch (GenICam::GenericException &e)
+					{
+						std::cerr << "catch at m_ImageConverter.Convert: " << e.GetDescription() << "\n";
+						outMat = cv::Mat();
+					}
+					deliver(outMat, ptrGrabResult, hostTime);
+				}
+				else if (nativeMonoType(ptrGrabResult->GetPixelType()) >= 0)
+				{
+					// native Mono8 / Mono16 containers need no converter: lend the grab buffer,
+					// or copy it once when too many grab buffers are held by callers already
+					int type = nativeMonoType(ptrGrabResult->GetPixelType());
+					size_t step = width * CV_ELEM_SIZE(type) + ptrGrabResult->GetPaddingX();
+					cv::Mat outMat;
+					if (lendGrabBuffer())
+					{
+						std::shared_ptr<void> owner(new Pylon::CGrabResultPtr(ptrGrabResult), GrabBufferReturner(m_pNumLentBuffers));
+						outMat = FrameAllocator::wrap(height, width, type, pImageBuffer, step, owner);
+					}
+					else
+					{
+						outMat = m_pCache->acquireFrame(height, width, type);
+						cv::Mat(height, width, type, pImageBuffer, step).copyTo(outMat);
+					}
+					deliver(outMat, ptrGrabResult, hostTime);
+				}
+				else if (packedMonoBitDepth(ptrGrabResult->GetPixelType()) > 0)
+				{
+					// Mono10p / Mono12p unpacked to 16 bit, keeping the full bit depth
+					int bitDepth = packedMonoBitDepth(ptrGrabResult->GetPixelType());
+					size_t step = MonoUnpack::getPackedRowSize(width, bitDepth) + ptrGrabResult->GetPaddingX();
+					cv::Mat outMat = m_pCache->acquireFrame(height, width, CV_16UC1);
+					if (MonoUnpack::run(pImageBuffer, step, width, height, bitDepth, (uint16_t *)outMat.data, outMat.step) != 0)
+					{
+						std::cerr << "MonoUnpack fail, width = " << width << ", height = " << height << "\n";
+						outMat = cv::Mat();
+					}
+					deliver(outMat, ptrGrabResult, hostTime);
+				}
+				else
+				{
+					cv::Mat outMat = m_pCache->acquireFrame(height, width, CV_8UC1);
+					m_ImageConverter.Convert(outMat.data, outMat.total() * outMat.elemSize(), ptrGrabResult);
+					deliver(outMat, ptrGrabResult, hostTime);
+				}
+				
+			}
+			else
+			{
+				std::cout << "ERROR pImageBuffer NULL" << "\n";
+			}
+		}
+		else
+		{
+			std::cout << "OnImageGrabbed Fail" << "\n";
+			uint32_t nError = ptrGrabResult->GetErrorCode();
+			Pylon::String_t strError = ptrGrabResult->GetErrorDescription();
+			std::cout << "ERROR OnImageGrabbed" << nError << "    " << strError << "\n";
+		}
+	}
+private:
+	// releases a lent grab buffer back to pylon when the last Mat using it is gone
+	struct GrabBufferReturner
+	{
+		GrabBufferReturner(const std::shared_ptr<std::atomic<int> > &pNumLent) : m_pNumLent(pNumLent) {}
+		void operator()(Pylon::CGrabResultPtr *pGrabResult)
+		{
+			delete pGrabResult;
+			m_pNumLent->fetch_sub(1);
+		}
+		std::shared_ptr<std::atomic<int> > m_pNumLent;
+	};
+
+	static int bayerPattern(Pylon::EPixelType pixelType)
+	{
+		switch (pixelType)
+		{
+		case Pylon::PixelType_BayerRG8: return BayerDemosaic::PATTERN_RG;
+		case Pylon::PixelType_BayerBG8: return BayerDemosaic::PATTERN_BG;
+		case Pylon::PixelType_BayerGR8: return BayerDemosaic::PATTERN_GR;
+		case Pylon::PixelType_BayerGB8: return BayerDemosaic::PATTERN_GB;
+		default: return -1;
+		}
+	}
+
+	// Mono10 / Mono12 come in 16 bit little endian containers, same layout as CV_16UC1
+	static int nativeMonoType(Pylon::EPixelType pixelType)
+	{
+		switch (pixelType)
+		{
+		case Pylon::PixelType_Mono8: return CV_8UC1;
+		case Pylon::PixelType_Mono10:
+		case Pylon::PixelType_Mono12:
+		case Pylon::PixelType_Mono16: return CV_16UC1;
+		default: return -1;
+		}
+	}
+
+	static int packedMonoBitDepth(Pylon::EPixelType pixelType)
+	{
+		switch (pixelType)
+		{
+		case Pylon::PixelType_Mono10p: return 10;
+		case Pylon::PixelType_Mono12p: return 12;
+		default: return 0;
+		}
+	}
+
+	// subscribers see every frame, the cache only the frames it was armed for
+	void deliver(const cv::Mat &img, const Pylon::CGrabResultPtr& ptrGrabResult, std::chrono::steady_clock::time_point hostTime)
+	{
+		Frame frame;
+		frame.image = img;
+		frame.camSN = m_camSN;
+		frame.camIdx = m_camIdx;
+		frame.timestamp = ptrGrabResult->GetTimeStamp();
+		frame.blockID = ptrGrabResult->GetBlockID();
+		frame.imageNumber = ptrGrabResult->GetImageNumber();
+		frame.numSkipped = ptrGrabResult->GetNumberOfSkippedImages();
+		frame.exposureTime = m_exposureTime;
+		frame.hostTime = hostTime;
+		readChunks(ptrGrabResult, frame.chunks);
+		m_subscribers.deliver(frame);
+		m_pCache->recvFrame(frame);
+	}
+
+	// The node handles are looked up once per grab buffer. Reading them afterwards parses the
+	// buffer already received, without a round trip to the camera.
+	void readChunks(const Pylon::CGrabResultPtr& ptrGrabResult, FrameChunks &chunks)
+	{
+		int selected = m_chunks.load(std::memory_order_relaxed);
+		if (selected == 0 || !ptrGrabResult->IsChunkDataAvailable())
+		{
+			return;
+		}
+		try
+		{
+			INodeMap &nodemap = ptrGrabResult->GetChunkDataNodeMap();
+			std::map<INodeMap*, ChunkNodes>::iterator it = m_chunkNodes.find(&nodemap);
+			if (it == m_chunkNodes.end())
+			{
+				ChunkNodes nodes;
+				nodes.exposureTime = nodemap.GetNode("ChunkExposureTime");
+				nodes.gain = nodemap.GetNode("ChunkGain");
+				nodes.lineStatusAll = nodemap.GetNode("ChunkLineStatusAll");
+				nodes.counterValue = nodemap.GetNode("ChunkCounterValue");
+				nodes.timestamp = nodemap.GetNode("ChunkTimestamp");
+				it = m_chunkNodes.insert(std::make_pair(&nodemap, nodes)).first;
+			}
+			const ChunkNodes &nodes = it->second;
+			if ((selected & baslerCaptureItf::CHUNK_EXPOSURE_TIME) && IsReadable(nodes.exposureTime))
+			{
+				chunks.exposureTime = nodes.exposureTime->GetValue();
+			}
+			if ((selected & baslerCaptureItf::CHUNK_GAIN) && IsReadable(nodes.gain))
+			{
+				chunks.gain = nodes.gain->GetValue();
+			}
+			if ((selected & baslerCaptureItf::CHUNK_LINE_STATUS) && IsReadable(nodes.lineStatusAll))
+			{
+				chunks.lineStatusAll = nodes.lineStatusAll->GetValue();
+			}
+			if ((selected & baslerCaptureItf::CHUNK_TRIGGER_COUNTER) && IsReadable(nodes.counterValue))
+			{
+				chunks.triggerCounter = nodes.counterValue->GetValue();
+			}
+			if ((selected & baslerCaptureItf::CHUNK_TIMESTAMP) && IsReadable(nodes.timestamp))
+			{
+				chunks.timestamp = nodes.timestamp->GetValue();
+			}
+		}
+		catch (GenICam::GenericException &e)
+		{
+			std::cerr << "chunk data fail: " << e.GetDescription() << "\n";
+		}
+	}
+
+	bool lendGrabBuffer()
+	{
+		if (m_pNumLentBuffers->fetch_add(1) < m_nMaxLentBuffers)
+		{
+			return true;
+		}
+		m_pNumLentBuffers->fetch_sub(1);
+		return false;
+	}
+
+private:
+	bool m_bIsColor = false;
+	ImageCache* m_pCache = NULL;
+	FrameSubscribers m_subscribers;
+	std::string m_camSN;
+	int m_camIdx = -1;
+	std::atomic<double> m_exposureTime{ 0 };
+	Pylon::CImageFormatConverter m_ImageConverter;
+	int m_nMaxLentBuffers = 0;
+	std::atomic<int> m_demosaicMode{ baslerCaptureItf::DEMOSAIC_PYLON }; // written by the user thread, read per frame
+	std::shared_ptr<std::atomic<int> > m_pNumLentBuffers; // shared with the Mats still holding grab buffers
+
+	struct ChunkNodes
+	{
+		CFloatPtr exposureTime;
+		CFloatPtr gain;
+		CIntegerPtr lineStatusAll;
+		CIntegerPtr counterValue;
+		CIntegerPtr timestamp;
+	};
+	std::atomic<int> m_chunks{ 0 };
+	std::map<INodeMap*, ChunkNodes> m_chunkNodes; // by chunk nodemap of a grab buffer, grab thread only
+};
+
+/****************************************
+
+DeviceRemovalHandler
+
+*****************************************/
+// Forwards pylon's device removal event, which arrives on a pylon thread.
+class DeviceRemovalHandler : public Pylon::CConfigurationEventHandler
+{
+public:
+	void setOnRemoved(const std::function<void()> &onRemoved)
+	{
+		m_onRemoved = onRemoved;
+	}
+
+	virtual void OnCameraDeviceRemoved(CInstantCamera &camera)
+	{
+		if (m_onRemoved)
+		{
+			m_onRemoved();
+		}
+	}
+
+private:
+	std::function<void()> m_onRemoved;
+};
+
+/****************************************
+
+baslerCam
+
+*****************************************/
+class baslerCam
+{
+public:
+	baslerCam() {};
+	~baslerCam();
+	int init(CDeviceInfo info);
+	int setCamIdx(int camIdx);
+	std::string getSerial();
+	int configurateExposure(float exposureTime); // microsec
+	int configuratePixelFormat(const std::string &pixelFormat);
+	int configurate(const CameraConfig &config);
+	int start();
+	int stop();
+	int readyHWTrig(int numOfTrig);
+	int getHWTrigImgs(std::vector<Frame> &frames, std::chrono::steady_clock::time_point deadline);
+	int startHWTrigStream(int queueSize);
+	int readHWTrigStream(std::vector<Frame> &frames, int maxFrames, std::chrono::steady_clock::time_point deadline);
+	int stopHWTrigStream(std::vector<Frame> &frames);
+	int64_t getNumOfDroppedFrames();
+	int setTimeout(int timeoutMs);
+	int getTimeout();
+	std::chrono::steady_clock::time_point getDeadline();
+	int cancelWaits();
+	int ExecuteSWTrig(Frame& frame);
+	int setContinuous(bool bContinuous);
+	int getLatestImage(Frame& frame);
+	int setDemosaicMode(int mode);
+	int configurateStream(const StreamConfig &config);
+	int getStreamStatus(StreamStatus &status);
+	int setGrabStrategy(int strategy, int numImages);
+	int setGrabThread(const GrabThreadConfig &config);
+	int setChunks(int chunks);
+	int setDispatcher(CaptureDispatcher *pDispatcher);
+	int subscribe(int id, const std::function<void(const Frame &)> &callback, int dispatch);
+	int unsubscribe(int id);
+
+	// frame waits on this camera are serialized, other cameras are not affected
+	std::unique_lock<std::mutex> lockGrab();
+
+	// ExecuteSWTrig in steps, so that several cameras can be triggered back-to-back.
+	// The caller holds lockGrab() across the steps.
+	int armSWTrig();
+	int disarmSWTrig();
+	int fireSWTrig();
+	int collectSWTrig(Frame& frame, std::chrono::steady_clock::time_point deadline);
+
+	// Asynchronous capture: begin marks the armed frames as owed to the dispatcher,
+	// poll hands them over without blocking. The caller does not hold lockGrab().
+	int beginAsync(bool bHWTrig);
+	int abortAsync();
+	int pollAsync(std::vector<Frame> &frames, bool bTimedOut);
+
+	// A removed device marks the camera lost. reconnect() is polled by the capture's monitor
+	// thread: 1 while the device is not back or Mats still share its grab buffers, 0 once it is
+	// open again with its settings restored.
+	bool isLost();
+	int reconnect();
+	// Mats still sharing a grab buffer of this camera
+	int getNumLentBuffers();
+private:
+	int OpenDevice(CDeviceInfo info);
+	int CloseDevice();
+	void onDeviceRemoved();
+	int startGrabbing();
+	void stopGrabbing();
+	void grabLoop();
+	int writeExposure(float time);
+	int applyConfig(const CameraConfig &config);
+	int applyStreamConfig(const StreamConfig &config);
+	int writeChunks();
+	int reserveBuffers(int num);
+	int growBuffers(int num);
+	// the caller holds m_mu_device, they write nodes and the cached trigger state
+	int setTriggerSource(const char *source);
+	int setTriggerMode(const char *mode);
+private:
+	// grab buffers kept for pylon so acquisition never stalls on frames held by callers
+	static const int SPARE_GRAB_BUFFERS = 2;
+	// how often the own grab loop looks for a stop request
+	static const int GRAB_LOOP_POLL_MS = 100;
+
+	int m_UseDevIdx = 0;
+	std::string m_CamSN;
+	int m_camIdx = -1;
+	Pylon::CInstantCamera m_InstantCamera;
+	ImageEventHandler m_imageEventHandler;
+	DeviceRemovalHandler m_removalHandler;
+	ImageCache m_Cache;
+	bool m_bIsColor = false;
+	bool m_IsHWtriggerRunning = false;
+	std::atomic<bool> m_bHWTrigStreaming{ false };
+	bool m_bContinuous = false;
+	bool m_bAsyncPending = false; // frames of an asynchronous capture still outstanding
+	bool m_bGrabRequested = false; // grab state to restore after a reconnect
+	std::atomic<bool> m_bLost{ false };
+	std::mutex m_mu_grab;
+	std::mutex m_mu_device; // node access outside of lockGrab(), taken after m_mu_grab
+
+	// node handles resolved in OpenDevice, with the last value written
+	CEnumerationPtr m_ptrTriggerMode;
+	CEnumerationPtr m_ptrTriggerSelector;
+	CEnumerationPtr m_ptrTriggerSource;
+	CCommandPtr m_ptrTriggerSoftware;
+	CFloatPtr m_ptrExposureTime;
+	CEnumerationPtr m_ptrPixelFormat;
+	std::string m_triggerMode;
+	std::string m_triggerSource;
+	std::string m_pixelFormat;
+	float m_exposureTime = -1;
+
+	std::string m_hwTriggerLine = "Line1";
+	CameraConfig m_config; // last applied, again after a reconnect
+	bool m_bHasConfig = false;
+	StreamConfig m_streamConfig; // fields set through configurateStream(), again after a reconnect
+	int m_grabStrategy = baslerCaptureItf::GRAB_ONE_BY_ONE;
+	int m_numLatestImages = -1; // output queue size of GRAB_LATEST_IMAGES, again after a reconnect
+	GrabThreadConfig m_grabThreadConfig;
+	std::thread m_grabThread;
+	std::atomic<bool> m_bGrabLoopQuit{ false };
+	int m_chunks = 0; // CHUNK_* enabled through setChunks(), again after a reconnect
+};
+
+int baslerCam::init(CDeviceInfo info)
+{
+	int status = 0;
+	try
+	{
+		status = OpenDevice(info);
+		if (status != 0)
+		{
+			std::cerr << "init fail.\n";
+			return -1;
+		}
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << "init fail. \n";
+		std::cerr << e.what();
+		return -1;
+	}
+
+	return 0;
+}
+
+// position in the working camera list, known once all cameras of openDevices() are open
+int baslerCam::setCamIdx(int camIdx)
+{
+	m_camIdx = camIdx;
+	return m_imageEventHandler.setSource(m_CamSN, camIdx);
+}
+
+std::string baslerCam::getSerial()
+{
+	return m_CamSN;
+}
+
+baslerCam::~baslerCam()
+{
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	CloseDevice();
+}
+
+int baslerCam::OpenDevice(CDeviceInfo info)
+{
+	//  prepare m_InstantCamera
+	if (m_InstantCamera.IsPylonDeviceAttached())
+	{
+		m_InstantCamera.DetachDevice();
+		m_InstantCamera.DestroyDevice();
+	}
+
+	m_InstantCamera.Attach(CTlFactory::GetInstance().CreateDevice(info));
+	m_InstantCamera.Open();
+
+	std::string camModelName = std::string( CStringPtr(m_InstantCamera.GetNodeMap().GetNode("DeviceModelName"))->GetValue().c_str());
+	std::cout << "camModelName = " << camModelName << "\n";
+
+	//  assign sn
+	m_CamSN = info.GetSerialNumber().c_str();
+
+	// resolve the nodes used on the trigger path once
+	INodeMap &nodemap = m_InstantCamera.GetNodeMap();
+	m_ptrTriggerMode = nodemap.GetNode("TriggerMode");
+	m_ptrTriggerSelector = nodemap.GetNode("TriggerSelector");
+	m_ptrTriggerSource = nodemap.GetNode("TriggerSource");
+	m_ptrTriggerSoftware = nodemap.GetNode("TriggerSoftware");
+	m_ptrExposureTime = nodemap.GetNode("ExposureTime");
+	m_ptrPixelFormat = nodemap.GetNode("PixelFormat");
+	m_triggerMode.clear();
+	m_triggerSource.clear();
+	m_pixelFormat.clear();
+	m_exposureTime = -1;
+
+	// default trigger mode since it does not waste resources
+	// Set trigger and expose
+	if (IsWritable(m_ptrTriggerSelector))
+	{
+		m_ptrTriggerSelector->FromString("FrameStart");
+	}
+	setTriggerMode("On");
+
+	// Set color
+	bool bIsColor = false;
+	const char * pchar = camModelName.c_str();
+	if ('m' == pchar[camModelName.size() - 1])
+	{
+		std::cout << "it is mono camera" << "\n";
+		bIsColor = false;
+	}
+	else if ('c' == pchar[camModelName.size() - 1])
+	{
+		std::cout << "it is RGB camera = " << "\n";
+		bIsColor = true;
+	}
+
+	// Set software trigger as default. SHould not use func to avoid the state check
+	setTriggerSource("Software");
+
+	if (m_chunks != 0)
+	{
+		writeChunks();
+	}
+
+	m_bIsColor = bIsColor;
+
+	// set ImageEventHandler 
+	m_InstantCamera.RegisterImageEventHandler(&m_imageEventHandler, RegistrationMode_Append, Cleanup_None);
+	m_removalHandler.setOnRemoved([this]() {
+		onDeviceRemoved();
+	});
+	m_InstantCamera.RegisterConfiguration(&m_removalHandler, RegistrationMode_Append, Cleanup_None);
+	m_imageEventHandler.setCache(&m_Cache);
+	m_imageEventHandler.setColor(bIsColor);
+	m_imageEventHandler.setSource(m_CamSN, m_camIdx);
+	if (IsReadable(m_ptrExposureTime))
+	{
+		m_imageEventHandler.setExposureTime(m_ptrExposureTime->GetValue());
+	}
+
+	return 0;
+}
+
+int baslerCam::configurateExposure(float time)
+{
+	std::lock_guard<std::mutex> lk(m_mu_device);
+	if (m_bLost)
+	{
+		std::cerr << m_CamSN << " is lost, exposure not set.\n";
+		return -1;
+	}
+	return writeExposure(time);
+}
+
+int baslerCam::writeExposure(float time)
+{
+	if (time == m_exposureTime)
+	{
+		return 0;
+	}
+	m_ptrExposureTime->SetValue(time);
+	m_exposureTime = time;
+	m_imageEventHandler.setExposureTime(time);
+	return 0;
+}
+
+// every node write is a bus round trip, skip it when the value is unchanged
+static int writeEnumCached(CEnumerationPtr &ptrNode, std::string &lastValue, const char *value)
+{
+	if (lastValue == value)
+	{
+		return 0;
+	}
+	ptrNode->FromString(value);
+	lastValue = value;
+	return 0;
+}
+
+int baslerCam::setTriggerSource(const char *source)
+{
+	return writeEnumCached(m_ptrTriggerSource, m_triggerSource, source);
+}
+
+int baslerCam::setTriggerMode(const char *mode)
+{
+	return writeEnumCached(m_ptrTriggerMode, m_triggerMode, mode);
+}
+
+// PixelFormat is locked while grabbing, the frame pool follows it on the next start()
+int baslerCam::configuratePixelFormat(const std::string &pixelFormat)
+{
+	std::lock_guard<std::mutex> lk(m_mu_device);
+	if (m_bLost)
+	{
+		std::cerr << m_CamSN << " is lost, pixel format not set.\n";
+		return -1;
+	}
+	if (m_InstantCamera.IsGrabbing())
+	{
+		std::cerr << "camera is grabbing, stop before changing pixel format.\n";
+		return -1;
+	}
+	try
+	{
+		writeEnumCached(m_ptrPixelFormat, m_pixelFormat, pixelFormat.c_str());
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " does not support pixel format " << pixelFormat << ": " << e.GetDescription() << "\n";
+		return -1;
+	}
+	return 0;
+}
+
+
+// Offset and size limit each other, the offset is moved out of the way before resizing.
+static void writeRoi(INodeMap &nodemap, const char *offsetName, const char *sizeName, int offset, int size)
+{
+	CIntegerPtr ptrOffset(nodemap.GetNode(offsetName));
+	CIntegerPtr ptrSize(nodemap.GetNode(sizeName));
+	if (size > 0)
+	{
+		if (offset >= 0)
+		{
+			ptrOffset->SetValue(ptrOffset->GetMin());
+		}
+		ptrSize->SetValue(size);
+	}
+	if (offset >= 0)
+	{
+		ptrOffset->SetValue(offset);
+	}
+}
+
+// node writes of a CameraConfig, the caller holds both locks and catches GenICam exceptions
+int baslerCam::applyConfig(const CameraConfig &config)
+{
+	INodeMap &nodemap = m_InstantCamera.GetNodeMap();
+	if (!config.featureFile.empty())
+	{
+		CFeaturePersistence::Load(config.featureFile.c_str(), &nodemap, true);
+		// the file wrote behind the cached values, read back the ones restored after a reconnect
+		m_pixelFormat = IsReadable(m_ptrPixelFormat) ? m_ptrPixelFormat->ToString().c_str() : "";
+		if (IsReadable(m_ptrExposureTime))
+		{
+			m_exposureTime = (float)m_ptrExposureTime->GetValue();
+			m_imageEventHandler.setExposureTime(m_exposureTime);
+		}
+		m_triggerMode.clear();
+		m_triggerSource.clear();
+		if (IsWritable(m_ptrTriggerSelector))
+		{
+			m_ptrTriggerSelector->FromString("FrameStart");
+		}
+	}
+	if (config.exposureTime >= 0)
+	{
+		writeExposure(config.exposureTime);
+	}
+	if (config.gain >= 0)
+	{
+		CFloatPtr(nodemap.GetNode("Gain"))->SetValue(config.gain);
+	}
+	writeRoi(nodemap, "OffsetX", "Width", config.offsetX, config.width);
+	writeRoi(nodemap, "OffsetY", "Height", config.offsetY, config.height);
+	if (!config.pixelFormat.empty())
+	{
+		writeEnumCached(m_ptrPixelFormat, m_pixelFormat, config.pixelFormat.c_str());
+	}
+	if (!config.triggerLine.empty())
+	{
+		m_hwTriggerLine = config.triggerLine;
+	}
+	if (!config.triggerActivation.empty())
+	{
+		CEnumerationPtr(nodemap.GetNode("TriggerActivation"))->FromString(config.triggerActivation.c_str());
+	}
+	if (config.triggerDelay >= 0)
+	{
+		CFloatPtr(nodemap.GetNode("TriggerDelay"))->SetValue(config.triggerDelay);
+	}
+
+	// trigger mode, source and chunks follow this library, whatever the file says
+	if (m_chunks != 0)
+	{
+		writeChunks();
+	}
+	setTriggerMode(m_bContinuous ? "Off" : "On");
+	setTriggerSource(m_IsHWtriggerRunning || m_bHWTrigStreaming ? m_hwTriggerLine.c_str() : "Software");
+	return 0;
+}
+
+// ROI, pixel format and feature files need the camera stopped, a grabbing camera is restarted
+int baslerCam::configurate(const CameraConfig &config)
+{
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	if (m_bLost)
+	{
+		std::cerr << m_CamSN << " is lost, configuration not applied.\n";
+		return -1;
+	}
+	if (m_IsHWtriggerRunning || m_bAsyncPending || m_bHWTrigStreaming)
+	{
+		std::cerr << "capture pending, cannot change configuration.\n";
+		return -1;
+	}
+
+	int status = 0;
+	bool bRestart = m_InstantCamera.IsGrabbing();
+	try
+	{
+		if (bRestart)
+		{
+			stopGrabbing();
+		}
+		applyConfig(config);
+		m_config = config;
+		m_bHasConfig = true;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " configuration fail: " << e.GetDescription() << "\n";
+		status = -1;
+	}
+
+	if (bRestart)
+	{
+		try
+		{
+			startGrabbing();
+		}
+		catch (GenICam::GenericException &e)
+		{
+			std::cerr << m_CamSN << " restart fail: " << e.GetDescription() << "\n";
+			status = -1;
+		}
+	}
+	return status;
+}
+
+int baslerCam::CloseDevice()
+{
+	stopGrabbing();
+	if (m_InstantCamera.IsOpen())
+	{
+		m_InstantCamera.Close();
+	}
+
+	m_InstantCamera.DeregisterImageEventHandler(&m_imageEventHandler);
+	m_InstantCamera.DeregisterConfiguration(&m_removalHandler);
+
+	if (m_InstantCamera.IsPylonDeviceAttached())
+	{
+		m_InstantCamera.DetachDevice();
+		m_InstantCamera.DestroyDevice();
+	}
+
+	return 0;
+}
 
 int baslerCam::start()
 {
-	if (m_InstantCamera.IsOpen())
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	if (m_bLost)
+	{
+		// reconnect() starts it
+		m_bGrabRequested = true;
+		return 0;
+	}
+	int status = startGrabbing();
+	if (status == 0)
+	{
+		m_bGrabRequested = true;
+	}
+	return status;
+}
+
+static EGrabStrategy toPylonStrategy(int strategy)
+{
+	switch (strategy)
+	{
+	case baslerCaptureItf::GRAB_LATEST_IMAGE_ONLY:
+		return GrabStrategy_LatestImageOnly;
+	case baslerCaptureItf::GRAB_LATEST_IMAGES:
+		return GrabStrategy_LatestImages;
+	case baslerCaptureItf::GRAB_UPCOMING_IMAGE:
+		return GrabStrategy_UpcomingImage;
+	default:
+		return GrabStrategy_OneByOne;
+	}
+}
+
+// Starting, stopping and the own grab thread are guarded by m_mu_grab and m_mu_device,
+// which every caller holds.
+int baslerCam::startGrabbing()
+{
+	if (m_InstantCamera.IsOpen())
+	{
+		if (!m_InstantCamera.IsGrabbing())
+		{
+			std::cout << "m_InstantCamera start capture ..." << "\n";
+			m_imageEventHandler.setMaxLentBuffers((int)m_InstantCamera.MaxNumBuffer.GetValue() - SPARE_GRAB_BUFFERS);
+			m_imageEventHandler.resetChunkNodes();
+			// size the frame pool for the current ROI and output format
+			CIntegerPtr width(m_InstantCamera.GetNodeMap().GetNode("Width"));
+			CIntegerPtr height(m_InstantCamera.GetNodeMap().GetNode("Height"));
+			std::string strPixelFormat;
+			if (IsReadable(m_ptrPixelFormat))
+			{
+				strPixelFormat = m_ptrPixelFormat->ToString().c_str();
+			}
+			int rows = 0;
+			int cols = 0;
+			int type = 0;
+			m_imageEventHandler.getFrameFormat(strPixelFormat, (int)width->GetValue(), (int)height->GetValue(), rows, cols, type);
+			m_Cache.allocate(rows, cols, type);
+			if (!m_grabThreadConfig.bOwnThread)
+			{
+				m_InstantCamera.StartGrabbing(toPylonStrategy(m_grabStrategy), GrabLoop_ProvidedByInstantCamera);
+				return 0;
+			}
+			// a loop left over from grabbing that pylon ended by itself, e.g. on a device removal
+			stopGrabbing();
+			m_InstantCamera.StartGrabbing(toPylonStrategy(m_grabStrategy), GrabLoop_ProvidedByUser);
+			m_bGrabLoopQuit = false;
+			m_grabThread = std::thread(&baslerCam::grabLoop, this);
+			return 0;
+		}
+		else
+		{
+			std::cout << "Camera is grabbing already." << "\n";
+		}
+	}
+	else
+	{
+		std::cerr << "Camera is not open." << "\n";
+	}
+	return -1;
+}
+
+// The own grab loop is joined first, RetrieveResult must not run into StopGrabbing.
+// The caller holds m_mu_grab and m_mu_device, see startGrabbing().
+void baslerCam::stopGrabbing()
+{
+	if (m_grabThread.joinable())
+	{
+		m_bGrabLoopQuit = true;
+		m_grabThread.join();
+	}
+	if (m_InstantCamera.IsGrabbing())
+	{
+		m_InstantCamera.StopGrabbing();
+	}
+}
+
+// GrabLoop_ProvidedByUser: RetrieveResult calls the image event handler on this thread
+void baslerCam::grabLoop()
+{
+	pinCurrentThread(m_grabThreadConfig.cpus);
+	setCurrentThreadPriority(m_grabThreadConfig.realtimePriority, m_grabThreadConfig.nice);
+	m_Cache.prefault();
+
+	// pylon may end grabbing by itself, e.g. on a device removal; stopGrabbing() joins the loop later
+	bool bFailing = false;
+	while (!m_bGrabLoopQuit && m_InstantCamera.IsGrabbing())
+	{
+		CGrabResultPtr ptrGrabResult;
+		try
+		{
+			m_InstantCamera.RetrieveResult(GRAB_LOOP_POLL_MS, ptrGrabResult, TimeoutHandling_Return);
+			bFailing = false;
+		}
+		catch (GenICam::GenericException &e)
+		{
+			// e.g. a removed device until reconnect() closes it, report it once
+			if (!bFailing)
+			{
+				std::cerr << m_CamSN << " retrieve result fail: " << e.GetDescription() << "\n";
+			}
+			bFailing = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(GRAB_LOOP_POLL_MS));
+		}
+	}
+}
+
+// The caller holds m_mu_grab. Grabbing is stopped and started under both locks, like everywhere else.
+int baslerCam::reserveBuffers(int num)
+{
+	std::lock_guard<std::mutex> lk(m_mu_device);
+	return growBuffers(num);
+}
+
+// A burst of num frames must fit in the frame queue and, while the consumer holds on to frames,
+// in pylon's grab buffers. Both can only grow while the grab thread is not running.
+// The caller holds m_mu_grab and m_mu_device.
+int baslerCam::growBuffers(int num)
+{
+	int numBuffers = num + SPARE_GRAB_BUFFERS;
+	bool bGrowBuffers = m_streamConfig.maxNumBuffer < 0 && m_InstantCamera.MaxNumBuffer.GetValue() < numBuffers;
+	bool bGrowCache = num > m_Cache.capacity();
+	bool bRestart = (bGrowBuffers || bGrowCache) && m_InstantCamera.IsGrabbing();
+	if (bRestart)
+	{
+		stopGrabbing();
+	}
+	if (bGrowBuffers)
+	{
+		m_InstantCamera.MaxNumBuffer.SetValue(numBuffers);
+		std::cout << m_CamSN << " MaxNumBuffer = " << numBuffers << "\n";
+	}
+	m_Cache.reserve(num);
+	if (bRestart)
+	{
+		return startGrabbing();
+	}
+	return 0;
+}
+
+// the stream grabber parameters differ per transport layer
+static int writeStreamParam(INodeMap &nodemap, const char *name, int value)
+{
+	if (value < 0)
+	{
+		return 0;
+	}
+	CIntegerPtr ptr(nodemap.GetNode(name));
+	if (!IsWritable(ptr))
+	{
+		std::cerr << name << " not supported by the stream grabber.\n";
+		return -1;
+	}
+	ptr->SetValue(value);
+	return 0;
+}
+
+int baslerCam::applyStreamConfig(const StreamConfig &config)
+{
+	int status = 0;
+	if (config.maxNumBuffer >= 0)
+	{
+		m_InstantCamera.MaxNumBuffer.SetValue(config.maxNumBuffer);
+	}
+	if (config.outputQueueSize >= 0)
+	{
+		m_InstantCamera.OutputQueueSize.SetValue(config.outputQueueSize);
+	}
+	INodeMap &nodemap = m_InstantCamera.GetStreamGrabberNodeMap();
+	status |= writeStreamParam(nodemap, "MaxBufferSize", config.maxBufferSize);
+	status |= writeStreamParam(nodemap, "MaxTransferSize", config.maxTransferSize);
+	status |= writeStreamParam(nodemap, "NumMaxQueuedUrbs", config.numMaxQueuedUrbs);
+	return status;
+}
+
+int baslerCam::configurateStream(const StreamConfig &config)
+{
+	if (config.maxNumBuffer >= 0 && config.maxNumBuffer <= SPARE_GRAB_BUFFERS)
+	{
+		std::cerr << "maxNumBuffer must be above " << SPARE_GRAB_BUFFERS << ".\n";
+		return -1;
+	}
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	if (m_bLost)
+	{
+		std::cerr << m_CamSN << " is lost, stream configuration not applied.\n";
+		return -1;
+	}
+	if (m_IsHWtriggerRunning || m_bAsyncPending || m_bHWTrigStreaming)
+	{
+		std::cerr << "capture pending, cannot change stream configuration.\n";
+		return -1;
+	}
+
+	int status = 0;
+	bool bRestart = m_InstantCamera.IsGrabbing();
+	try
+	{
+		if (bRestart)
+		{
+			stopGrabbing();
+		}
+		status = applyStreamConfig(config);
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " stream configuration fail: " << e.GetDescription() << "\n";
+		status = -1;
+	}
+
+	// remembered field by field, so that separate calls add up
+	int StreamConfig::*fields[] = { &StreamConfig::maxNumBuffer, &StreamConfig::maxBufferSize,
+		&StreamConfig::maxTransferSize, &StreamConfig::numMaxQueuedUrbs, &StreamConfig::outputQueueSize };
+	for (int i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+	{
+		if (config.*fields[i] >= 0)
+		{
+			m_streamConfig.*fields[i] = config.*fields[i];
+		}
+	}
+
+	if (bRestart)
+	{
+		try
+		{
+			startGrabbing();
+		}
+		catch (GenICam::GenericException &e)
+		{
+			std::cerr << m_CamSN << " restart fail: " << e.GetDescription() << "\n";
+			status = -1;
+		}
+	}
+	return status;
+}
+
+// The pylon strategy takes effect when grabbing starts, the cache policy right away
+int baslerCam::setGrabStrategy(int strategy, int numImages)
+{
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	if (m_IsHWtriggerRunning || m_bAsyncPending || m_bHWTrigStreaming)
+	{
+		std::cerr << "capture pending, cannot change grab strategy.\n";
+		return -1;
+	}
+
+	// a lost camera is only remembered, reconnect() starts grabbing with it
+	int status = 0;
+	bool bRestart = !m_bLost && m_InstantCamera.IsGrabbing();
+	try
+	{
+		if (bRestart)
+		{
+			stopGrabbing();
+		}
+		if (!m_bLost && strategy == baslerCaptureItf::GRAB_LATEST_IMAGES)
+		{
+			growBuffers(numImages);
+			m_InstantCamera.OutputQueueSize.SetValue(numImages);
+		}
+		m_grabStrategy = strategy;
+		m_Cache.setOverwriteOldest(strategy != baslerCaptureItf::GRAB_ONE_BY_ONE);
+		m_numLatestImages = strategy == baslerCaptureItf::GRAB_LATEST_IMAGES ? numImages : -1;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " grab strategy fail: " << e.GetDescription() << "\n";
+		status = -1;
+	}
+
+	if (bRestart)
+	{
+		try
+		{
+			startGrabbing();
+		}
+		catch (GenICam::GenericException &e)
+		{
+			std::cerr << m_CamSN << " restart fail: " << e.GetDescription() << "\n";
+			status = -1;
+		}
+	}
+	return status;
+}
+
+int baslerCam::setGrabThread(const GrabThreadConfig &config)
+{
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	if (m_IsHWtriggerRunning || m_bAsyncPending || m_bHWTrigStreaming)
+	{
+		std::cerr << "capture pending, cannot change grab thread.\n";
+		return -1;
+	}
+	if (m_bLost)
+	{
+		// reconnect() starts grabbing with it
+		m_grabThreadConfig = config;
+		return 0;
+	}
+
+	int status = 0;
+	bool bRestart = m_InstantCamera.IsGrabbing();
+	try
+	{
+		if (bRestart)
+		{
+			stopGrabbing();
+		}
+		m_grabThreadConfig = config;
+		if (bRestart)
+		{
+			startGrabbing();
+		}
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " grab thread fail: " << e.GetDescription() << "\n";
+		status = -1;
+	}
+	return status;
+}
+
+// ChunkSelector entries of the CHUNK_* values, SFNC names as on USB3 cameras.
+// ImageEventHandler::readChunks() reads the matching Chunk* nodes.
+struct ChunkEntry
+{
+	int chunk;
+	const char *selector;
+};
+static const ChunkEntry CHUNK_ENTRIES[] = {
+	{ baslerCaptureItf::CHUNK_EXPOSURE_TIME, "ExposureTime" },
+	{ baslerCaptureItf::CHUNK_GAIN, "Gain" },
+	{ baslerCaptureItf::CHUNK_LINE_STATUS, "LineStatusAll" },
+	{ baslerCaptureItf::CHUNK_TRIGGER_COUNTER, "CounterValue" },
+	{ baslerCaptureItf::CHUNK_TIMESTAMP, "Timestamp" },
+};
+
+// camera not grabbing
+int baslerCam::writeChunks()
+{
+	INodeMap &nodemap = m_InstantCamera.GetNodeMap();
+	CBooleanPtr ptrChunkModeActive(nodemap.GetNode("ChunkModeActive"));
+	if (!IsWritable(ptrChunkModeActive))
+	{
+		if (m_chunks == 0)
+		{
+			return 0;
+		}
+		std::cerr << m_CamSN << " has no chunk mode.\n";
+		return -1;
+	}
+	if (m_chunks == 0)
+	{
+		ptrChunkModeActive->SetValue(false);
+		return 0;
+	}
+	ptrChunkModeActive->SetValue(true);
+
+	int status = 0;
+	CEnumerationPtr ptrChunkSelector(nodemap.GetNode("ChunkSelector"));
+	CBooleanPtr ptrChunkEnable(nodemap.GetNode("ChunkEnable"));
+	for (int i = 0; i < sizeof(CHUNK_ENTRIES) / sizeof(CHUNK_ENTRIES[0]); ++i)
+	{
+		bool bEnable = (m_chunks & CHUNK_ENTRIES[i].chunk) != 0;
+		try
+		{
+			ptrChunkSelector->FromString(CHUNK_ENTRIES[i].selector);
+			ptrChunkEnable->SetValue(bEnable);
+		}
+		catch (GenICam::GenericException &e)
+		{
+			if (bEnable)
+			{
+				std::cerr << m_CamSN << " chunk " << CHUNK_ENTRIES[i].selector << " not supported: " << e.GetDescription() << "\n";
+				status = -1;
+			}
+		}
+	}
+
+	if (m_chunks & baslerCaptureItf::CHUNK_TRIGGER_COUNTER)
+	{
+		try
+		{
+			// Counter1 counting frame triggers, so cameras on the same trigger count alike
+			CEnumerationPtr(nodemap.GetNode("ChunkCounterSelector"))->FromString("Counter1");
+			CEnumerationPtr(nodemap.GetNode("CounterSelector"))->FromString("Counter1");
+			CEnumerationPtr(nodemap.GetNode("CounterEventSource"))->FromString("FrameTrigger");
+		}
+		catch (GenICam::GenericException &e)
+		{
+			std::cerr << m_CamSN << " trigger counter not set up: " << e.GetDescription() << "\n";
+			status = -1;
+		}
+	}
+	return status;
+}
+
+int baslerCam::setChunks(int chunks)
+{
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	if (m_IsHWtriggerRunning || m_bAsyncPending || m_bHWTrigStreaming)
+	{
+		std::cerr << "capture pending, cannot change chunks.\n";
+		return -1;
+	}
+
+	m_chunks = chunks;
+	m_imageEventHandler.setChunks(chunks);
+	if (m_bLost)
+	{
+		// OpenDevice() enables them on reconnect
+		return 0;
+	}
+
+	int status = 0;
+	bool bRestart = m_InstantCamera.IsGrabbing();
+	try
+	{
+		if (bRestart)
+		{
+			stopGrabbing();
+		}
+		status = writeChunks();
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " chunks fail: " << e.GetDescription() << "\n";
+		status = -1;
+	}
+
+	if (bRestart)
+	{
+		try
+		{
+			startGrabbing();
+		}
+		catch (GenICam::GenericException &e)
+		{
+			std::cerr << m_CamSN << " restart fail: " << e.GetDescription() << "\n";
+			status = -1;
+		}
+	}
+	return status;
+}
+
+static int64_t readStatistic(INodeMap &nodemap, const char *name)
+{
+	CIntegerPtr ptr(nodemap.GetNode(name));
+	return IsReadable(ptr) ? ptr->GetValue() : -1;
+}
+
+int baslerCam::getStreamStatus(StreamStatus &status)
+{
+	status = StreamStatus();
+	status.numLentBuffers = getNumLentBuffers();
+	status.numCachedFrames = m_Cache.size();
+	status.numDroppedFrames = m_Cache.getNumDropped();
+
+	std::lock_guard<std::mutex> lk(m_mu_device);
+	if (m_bLost)
+	{
+		return -1;
+	}
+	try
+	{
+		status.maxNumBuffer = (int)m_InstantCamera.MaxNumBuffer.GetValue();
+		status.numQueuedBuffers = (int)m_InstantCamera.NumQueuedBuffers.GetValue();
+		status.numReadyBuffers = (int)m_InstantCamera.NumReadyBuffers.GetValue();
+		status.numEmptyBuffers = (int)m_InstantCamera.NumEmptyBuffers.GetValue();
+		INodeMap &nodemap = m_InstantCamera.GetStreamGrabberNodeMap();
+		status.numBufferUnderruns = readStatistic(nodemap, "Statistic_Buffer_Underrun_Count");
+		status.numFailedBuffers = readStatistic(nodemap, "Statistic_Failed_Buffer_Count");
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " stream status fail: " << e.GetDescription() << "\n";
+		return -1;
+	}
+	return 0;
+}
+
+int baslerCam::stop()
+{
+	// nothing arrives once grabbing stops, so do not let anyone wait for it
+	cancelWaits();
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	m_bGrabRequested = false;
+	if (m_InstantCamera.IsOpen())
+	{
+		if (m_InstantCamera.IsGrabbing())
+		{
+			stopGrabbing();
+			return 0;
+		}
+	}
+	return -1;
+}
+
+std::unique_lock<std::mutex> baslerCam::lockGrab()
+{
+	return std::unique_lock<std::mutex>(m_mu_grab);
+}
+
+int baslerCam::readyHWTrig(int numOfTrig)
+{
+	std::lock_guard<std::mutex> lk(m_mu_grab);
+	if (m_bContinuous)
+	{
+		std::cerr << "camera is in continuous acquisition, hardware trigger not available.\n";
+		return -1;
+	}
+	if (m_bAsyncPending)
+	{
+		std::cerr << "asynchronous capture pending.\n";
+		return -1;
+	}
+	if (m_bHWTrigStreaming)
+	{
+		std::cerr << "hardware trigger stream running, stop it first.\n";
+		return -1;
+	}
+	if (m_bLost)
+	{
+		std::cerr << m_CamSN << " is lost, waiting for reconnect.\n";
+		return -1;
+	}
+
+	try
+	{
+		//--- set number of image to cache---
+		if (reserveBuffers(numOfTrig) != 0)
+		{
+			std::cerr << m_CamSN << " fails to reserve " << numOfTrig << " buffers.\n";
+			return -1;
+		}
+		m_Cache.arm(numOfTrig);
+
+		//--- set hw trigger mode ----
+		std::lock_guard<std::mutex> lkDevice(m_mu_device);
+		setTriggerSource(m_hwTriggerLine.c_str());
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " fails to ready hardware trigger: " << e.GetDescription() << "\n";
+		m_Cache.disarm();
+		return -1;
+	}
+	m_IsHWtriggerRunning = true;
+
+	return 0;
+}
+
+int baslerCam::getHWTrigImgs(std::vector<Frame> &frames, std::chrono::steady_clock::time_point deadline)
+{
+	std::lock_guard<std::mutex> lk(m_mu_grab);
+	int status = 0;
+
+	if (!m_IsHWtriggerRunning)
+	{
+		std::cerr << "Not hardwareTrigger Ready.Please ReadyHWTrig before calling this function.\n";
+		return -1;
+	}
+	if (m_bAsyncPending)
+	{
+		std::cerr << "asynchronous capture pending.\n";
+		return -1;
+	}
+
+	//--- get images ----
+	std::vector<Frame> _frames;
+	status = m_Cache.getImages(_frames, deadline);
+	m_Cache.disarm();
+	m_IsHWtriggerRunning = false;
+	if (status != 0)
+	{
+		// frames that did arrive are still handed over, a frame set can do without the lost ones
+		std::cerr << "get images fail.\n";
+		frames = _frames;
+		return status;
+	}
+
+	if (_frames.size() == 0)
+	{
+		std::cerr << "image invalid.\n";
+		return -1;
+	}
+
+	if (_frames[0].image.empty())
+	{
+		std::cerr << "image invalid.\n";
+		return -1;
+	}
+
+	frames = _frames;
+	return 0;
+}
+
+// like readyHWTrig, but the cache stays armed until stopHWTrigStream()
+int baslerCam::startHWTrigStream(int queueSize)
+{
+	std::lock_guard<std::mutex> lk(m_mu_grab);
+	if (m_bContinuous)
+	{
+		std::cerr << "camera is in continuous acquisition, hardware trigger not available.\n";
+		return -1;
+	}
+	if (m_IsHWtriggerRunning || m_bAsyncPending || m_bHWTrigStreaming)
+	{
+		std::cerr << "capture pending, cannot start hardware trigger stream.\n";
+		return -1;
+	}
+	if (m_bLost)
+	{
+		std::cerr << m_CamSN << " is lost, waiting for reconnect.\n";
+		return -1;
+	}
+
+	try
+	{
+		if (reserveBuffers(queueSize) != 0)
+		{
+			std::cerr << m_CamSN << " fails to reserve " << queueSize << " buffers.\n";
+			return -1;
+		}
+		m_Cache.arm(queueSize);
+		std::lock_guard<std::mutex> lkDevice(m_mu_device);
+		setTriggerSource(m_hwTriggerLine.c_str());
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " fails to start hardware trigger stream: " << e.GetDescription() << "\n";
+		m_Cache.disarm();
+		return -1;
+	}
+	m_bHWTrigStreaming = true;
+	return 0;
+}
+
+// 0 when frames were taken, 1 when none arrived before the deadline
+int baslerCam::readHWTrigStream(std::vector<Frame> &frames, int maxFrames, std::chrono::steady_clock::time_point deadline)
+{
+	std::lock_guard<std::mutex> lk(m_mu_grab);
+	if (!m_bHWTrigStreaming)
+	{
+		std::cerr << "hardware trigger stream not running.\n";
+		return -1;
+	}
+	return m_Cache.getStreamImages(frames, maxFrames, deadline);
+}
+
+// frames still queued are handed over, not dropped
+int baslerCam::stopHWTrigStream(std::vector<Frame> &frames)
+{
+	std::lock_guard<std::mutex> lk(m_mu_grab);
+	if (!m_bHWTrigStreaming)
+	{
+		return -1;
+	}
+	m_Cache.disarm();
+	m_Cache.getStreamImages(frames, 0, std::chrono::steady_clock::now());
+	m_bHWTrigStreaming = false;
+	return 0;
+}
+
+int64_t baslerCam::getNumOfDroppedFrames()
+{
+	return m_Cache.getNumDropped();
+}
+
+// no lock, a wait already in progress keeps its deadline
+int baslerCam::setTimeout(int timeoutMs)
+{
+	return m_Cache.setTimeout(timeoutMs);
+}
+
+int baslerCam::getTimeout()
+{
+	return m_Cache.getTimeout();
+}
+
+std::chrono::steady_clock::time_point baslerCam::getDeadline()
+{
+	return m_Cache.getDeadline();
+}
+
+// called without lockGrab(), which the waiter holds
+int baslerCam::cancelWaits()
+{
+	m_Cache.cancel();
+	return 0;
+}
+
+int baslerCam::ExecuteSWTrig(Frame& frame)
+{
+	std::unique_lock<std::mutex> lk(m_mu_grab);
+	int status = armSWTrig();
+	if (status != 0)
+	{
+		return status;
+	}
+
+	status = fireSWTrig();
+	if (status != 0)
+	{
+		disarmSWTrig();
+		return status;
+	}
+
+	return collectSWTrig(frame, getDeadline());
+}
+
+int baslerCam::armSWTrig()
+{
+	if (m_IsHWtriggerRunning)
+	{
+		return 1;
+	}
+	if (m_bHWTrigStreaming)
+	{
+		std::cerr << "hardware trigger stream running, software trigger not available.\n";
+		return -1;
+	}
+	if (m_bLost)
+	{
+		std::cerr << m_CamSN << " is lost, waiting for reconnect.\n";
+		return -1;
+	}
+	if (m_bContinuous)
+	{
+		std::cerr << "camera is in continuous acquisition, software trigger not available.\n";
+		return -1;
+	}
+	if (m_bAsyncPending)
+	{
+		std::cerr << "asynchronous capture pending.\n";
+		return -1;
+	}
+
+	//--- set number of image to cache---
+	m_Cache.arm(1);
+
+	// ---set softwaretrigger mode ---
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	setTriggerSource("Software");
+	return 0;
+}
+
+int baslerCam::disarmSWTrig()
+{
+	m_Cache.disarm();
+	return 0;
+}
+
+int baslerCam::fireSWTrig()
+{
+
+	// --- trigger execute
+	if (IsWritable(m_ptrTriggerSoftware))
+	{
+		m_ptrTriggerSoftware->Execute();
+	}
+	return 0;
+}
+
+int baslerCam::collectSWTrig(Frame& frame, std::chrono::steady_clock::time_point deadline)
+{
+	int status = 0;
+
+	std::vector<Frame> frames;
+	status = m_Cache.getImages(frames, deadline);
+	m_Cache.disarm();
+	if (status != 0)
+	{
+		std::cerr << "get images fail.\n";
+		return status;
+	}
+
+	if (frames.size() == 0)
+	{
+		std::cerr << "image invalid.\n";
+		return -1;
+	}
+
+	if (frames[0].image.empty())
+	{
+		std::cerr << "image invalid.\n";
+		return -1;
+	}
+
+	frame = frames[0];
+	return 0;
+}
+
+int baslerCam::beginAsync(bool bHWTrig)
+{
+	if (bHWTrig && !m_IsHWtriggerRunning)
+	{
+		std::cerr << "Not hardwareTrigger Ready.Please ReadyHWTrig before calling this function.\n";
+		return -1;
+	}
+	if (m_bAsyncPending)
+	{
+		std::cerr << "asynchronous capture pending.\n";
+		return -1;
+	}
+	m_bAsyncPending = true;
+	return 0;
+}
+
+// undoes beginAsync() when the capture cannot start on every camera, a readied hardware trigger stays armed
+int baslerCam::abortAsync()
+{
+	std::lock_guard<std::mutex> lk(m_mu_grab);
+	if (!m_IsHWtriggerRunning)
+	{
+		m_Cache.disarm();
+	}
+	m_bAsyncPending = false;
+	return 0;
+}
+
+// 1 while frames are outstanding, 0 when all arrived,
+// CAPTURE_TIMEOUT or CAPTURE_CANCELLED with the frames received so far
+int baslerCam::pollAsync(std::vector<Frame> &frames, bool bTimedOut)
+{
+	std::lock_guard<std::mutex> lk(m_mu_grab);
+	bool bCancelled = m_Cache.isCancelled();
+	int status = m_Cache.tryGetImages(frames, bTimedOut || bCancelled);
+	if (status != 0 && !bTimedOut && !bCancelled)
+	{
+		return 1;
+	}
+
+	m_Cache.disarm();
+	m_IsHWtriggerRunning = false;
+	m_bAsyncPending = false;
+	if (status != 0)
+	{
+		std::cerr << m_CamSN << (bCancelled ? " get images cancelled.\n" : " get images timeout!\n");
+		return bCancelled ? baslerCaptureItf::CAPTURE_CANCELLED : baslerCaptureItf::CAPTURE_TIMEOUT;
+	}
+	return 0;
+}
+
+
+// trigger off: the camera runs at its own frame rate and only the newest frame is kept
+int baslerCam::setContinuous(bool bContinuous)
+{
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	if (m_IsHWtriggerRunning || m_bAsyncPending || m_bHWTrigStreaming)
+	{
+		std::cerr << "capture pending, cannot change acquisition mode.\n";
+		return -1;
+	}
+
+	if (m_bLost)
+	{
+		std::cerr << m_CamSN << " is lost, waiting for reconnect.\n";
+		return -1;
+	}
+
+	m_Cache.setLatestOnly(bContinuous);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	setTriggerMode(bContinuous ? "Off" : "On");
+	m_bContinuous = bContinuous;
+	return 0;
+}
+
+int baslerCam::setDispatcher(CaptureDispatcher *pDispatcher)
+{
+	return m_Cache.setDispatcher(pDispatcher);
+}
+
+int baslerCam::subscribe(int id, const std::function<void(const Frame &)> &callback, int dispatch)
+{
+	return m_imageEventHandler.subscribers().add(id, callback, dispatch);
+}
+
+int baslerCam::unsubscribe(int id)
+{
+	return m_imageEventHandler.subscribers().remove(id);
+}
+
+int baslerCam::setDemosaicMode(int mode)
+{
+	if (!m_bIsColor)
+	{
+		std::cerr << "camera is mono, demosaic mode ignored.\n";
+		return -1;
+	}
+	return m_imageEventHandler.setDemosaicMode(mode);
+}
+
+int baslerCam::getLatestImage(Frame& frame)
+{
+	std::lock_guard<std::mutex> lk(m_mu_grab);
+	if (!m_bContinuous)
+	{
+		std::cerr << "camera is not in continuous acquisition.\n";
+		return -1;
+	}
+	return m_Cache.getLatest(frame);
+}
+
+// pylon thread. A running stream is left alone: its reader paces itself with its own timeout
+// and keeps reading once the camera is back, any other wait would only run into its timeout.
+void baslerCam::onDeviceRemoved()
+{
+	std::cerr << m_CamSN << " removed.\n";
+	m_bLost = true;
+	if (!m_bHWTrigStreaming)
+	{
+		m_Cache.cancel();
+	}
+}
+
+bool baslerCam::isLost()
+{
+	return m_bLost;
+}
+
+int baslerCam::getNumLentBuffers()
+{
+	return m_imageEventHandler.getNumLentBuffers();
+}
+
+int baslerCam::reconnect()
+{
+	std::lock_guard<std::mutex> lkGrab(m_mu_grab);
+	std::lock_guard<std::mutex> lkDevice(m_mu_device);
+	if (!m_bLost)
+	{
+		return 0;
+	}
+	// Mats lent from grab buffers of the lost device may still be read, reopen once all are back
+	if (getNumLentBuffers() > 0)
+	{
+		return 1;
+	}
+
+	try
+	{
+		CDeviceInfo filterInfo;
+		filterInfo.SetSerialNumber(m_CamSN.c_str());
+		DeviceInfoList_t filter;
+		filter.push_back(filterInfo);
+		DeviceInfoList_t listDeviceInfo;
+		if (CTlFactory::GetInstance().EnumerateDevices(listDeviceInfo, filter) == 0)
+		{
+			return 1;
+		}
+
+		// OpenDevice starts from the camera's power-up settings, bring back the ones set through us
+		float exposureTime = m_exposureTime;
+		std::string pixelFormat = m_pixelFormat;
+		CloseDevice();
+		OpenDevice(listDeviceInfo[0]);
+		if (m_bHasConfig)
+		{
+			applyConfig(m_config);
+		}
+		applyStreamConfig(m_streamConfig);
+		if (m_numLatestImages >= 0)
+		{
+			growBuffers(m_numLatestImages);
+			m_InstantCamera.OutputQueueSize.SetValue(m_numLatestImages);
+		}
+		if (exposureTime >= 0)
+		{
+			writeExposure(exposureTime);
+		}
+		if (!pixelFormat.empty())
+		{
+			writeEnumCached(m_ptrPixelFormat, m_pixelFormat, pixelFormat.c_str());
+		}
+		if (m_bContinuous)
+		{
+			setTriggerMode("Off");
+		}
+		if (m_IsHWtriggerRunning || m_bHWTrigStreaming)
+		{
+			setTriggerSource(m_hwTriggerLine.c_str());
+		}
+		if (m_bGrabRequested)
+		{
+			startGrabbing();
+		}
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << m_CamSN << " reconnect fail: " << e.GetDescription() << "\n";
+		return 1;
+	}
+
+	m_bLost = false;
+	std::cout << m_CamSN << " reconnected.\n";
+	return 0;
+}
+
+
+/****************************************
+
+baslerCapture
+
+*****************************************/
+class baslerCapture : public baslerCaptureItf
+{
+public:
+	baslerCapture();
+	virtual ~baslerCapture();
+
+	std::vector<std::string> getAvailableSNs();
+	int openDevices(const std::vector<std::string> &camSNs);
+	int openDevices(const std::vector<std::string> &camSNs, std::vector<int> &status);
+	int getNumOfWorkingDevices();
+	int configurateExposure(float exposureTime); // microsec
+	int configuratePixelFormat(const std::string &pixelFormat);
+	int configurateCameras(const std::map<std::string, CameraConfig> &configs, std::vector<int> &status);
+	int start();
+	int stop();
+	int readyHWTrig(int numOfTrig);
+	int getHWTrigImgs(std::vector<cv::Mat> &imgs);
+	int getHWTrigImgs(std::vector<Frame> &frames);
+	int getHWTrigFrameSets(std::vector<FrameSet> &sets, int syncMode, int64_t tolerance);
+	int startHWTrigStream(int queueSize);
+	int readHWTrigStream(std::vector<Frame> &frames, int maxFrames, int timeoutMs);
+	int stopHWTrigStream(std::vector<Frame> &frames);
+	int getNumOfDroppedFrames(std::vector<int64_t> &numDropped);
+	int setTimeout(int timeoutMs);
+	int cancelWaits();
+	int ExecuteSWTrig(std::vector<cv::Mat> &imgs);
+	int ExecuteSWTrig(std::vector<Frame> &frames);
+	int setSWTrigMode(int mode);
+	int setAcquisitionMode(int mode);
+	int getLatestImages(std::vector<cv::Mat> &imgs);
+	int getLatestImages(std::vector<Frame> &frames);
+	int getCurrentState();
+
+	int readyHWTrig(int camIdx, int numOfTrig);
+	int getHWTrigImgs(int camIdx, std::vector<cv::Mat> &imgs);
+	int getHWTrigImgs(int camIdx, std::vector<Frame> &frames);
+	int readHWTrigStream(int camIdx, std::vector<Frame> &frames, int maxFrames, int timeoutMs);
+	int setTimeout(int camIdx, int timeoutMs);
+	int isDeviceLost(int camIdx);
+	int configurateStream(int camIdx, const StreamConfig &config);
+	int getStreamStatus(int camIdx, StreamStatus &status);
+	int ExecuteSWTrig(int camIdx, cv::Mat &img);
+	int ExecuteSWTrig(int camIdx, Frame &frame);
+	int setDemosaicMode(int camIdx, int mode);
+	int setGrabStrategy(int camIdx, int strategy, int numImages);
+	int setGrabThread(int camIdx, const GrabThreadConfig &config);
+	int setChunks(int camIdx, int chunks);
+
+	std::future<CaptureResult> ExecuteSWTrigAsync();
+	int ExecuteSWTrigAsync(const CaptureCallback &callback);
+	std::future<CaptureResult> getHWTrigImgsAsync();
+	int getHWTrigImgsAsync(const CaptureCallback &callback);
+
+	int subscribe(int camIdx, const FrameCallback &callback, int dispatch);
+	int unsubscribe(int subscriptionId);
+	
+private:
+	std::vector<baslerCam*> getWorkingCameras();
+	baslerCam* getWorkingCamera(int camIdx);
+	int ExecuteSWTrigConcurrent(std::vector<Frame> &frames);
+	int postCapture(const std::vector<baslerCam*> &cams, const CaptureCallback &callback);
+	static std::chrono::steady_clock::time_point getDeadline(const std::vector<baslerCam*> &cams);
+	int initBaslerCameras();
+	int terminateBaslerCameras();
+
+	int createDevice(const std::string &camSN, baslerCam *&p_cam);
+	void startMonitor();
+	void stopMonitor();
+	void monitorLoop();
+	int setCurrentState(int state);
+private:
+	// Camera Devices
+	bool m_isInited = false;
+	int m_currentState = STOP_STATE;
+	std::atomic<int> m_swTrigMode; // SWTRIG_*, set from any thread
+	Pylon::DeviceInfoList_t m_listDeviceInfo; // last getAvailableSNs() listing
+	std::mutex m_mu_deviceInfo;
+
+	std::mutex m_mu_state;
+	std::mutex m_mu_cameras; // guards m_vpWorkingCameras, cameras are only added
+	std::vector<baslerCam*> m_vpWorkingCameras;
+
+	CaptureDispatcher m_dispatcher;
+	std::atomic<int> m_nextSubscriptionId{ 0 };
+
+	// reconnects lost cameras, started with the first camera
+	static const int RECONNECT_INTERVAL_MS = 1000;
+	std::thread m_monitorThread;
+	std::mutex m_mu_monitor;
+	std::condition_variable m_con_v_monitor;
+	bool m_bMonitorQuit = false;
+};
+baslerCapture::baslerCapture() : m_swTrigMode(SWTRIG_SEQUENTIAL)
+{
+	try
+	{
+		initBaslerCameras();
+	}
+	catch (GenICam::GenericException &e)
+	{
+		char buff[1024];
+		snprintf(buff, sizeof(buff), "Catch Exception InitAll() error: %s", e.GetDescription());
+		std::string str;
+		str = buff;
+		std::cout << str << "\n";
+	}
+}
+
+
+int baslerCapture::openDevices(const std::vector<std::string> &camSNs)
+{
+	std::vector<int> status;
+	return openDevices(camSNs, status);
+}
+
+// Opening a camera is mostly waiting on the device, so all of them are opened at once.
+// They join the working cameras in the order of camSNs, failed ones are left out.
+int baslerCapture::openDevices(const std::vector<std::string> &camSNs, std::vector<int> &status)
+{
+	std::vector<baslerCam*> newCams(camSNs.size(), NULL);
+	status.assign(camSNs.size(), -1);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < camSNs.size(); ++i)
+	{
+		threads.push_back(std::thread([this, &camSNs, &newCams, &status, i]() {
+			try
+			{
+				status[i] = createDevice(camSNs[i], newCams[i]);
+			}
+			catch (GenICam::GenericException &e)
+			{
+				char buff[1024];
+				snprintf(buff, sizeof(buff), "Catch Exception OpenDevice: %s", e.GetDescription());
+				std::string str;
+				str = buff;
+				std::cout << str << "\n";
+				status[i] = -1;
+			}
+			catch (std::exception &e)
+			{
+				// an exception leaving the thread would terminate the process, fail this camera only
+				std::cerr << camSNs[i] << " catch at OpenDevice: " << e.what() << "\n";
+				status[i] = -1;
+			}
+		}));
+	}
+	for (int i = 0; i < threads.size(); ++i)
+	{
+		threads[i].join();
+	}
+
+	int result = 0;
+	std::lock_guard<std::mutex> lk(m_mu_cameras);
+	for (int i = 0; i < camSNs.size(); ++i)
+	{
+		if (status[i] != 0)
+		{
+			std::cerr << camSNs[i] << " fails to open.\n";
+			delete newCams[i];
+			result = -1;
+			continue;
+		}
+		newCams[i]->setCamIdx((int)m_vpWorkingCameras.size());
+		newCams[i]->setDispatcher(&m_dispatcher);
+		m_vpWorkingCameras.push_back(newCams[i]);
+	}
+	if (!m_vpWorkingCameras.empty())
+	{
+		startMonitor();
+	}
+	return result;
+}
+
+void baslerCapture::startMonitor()
+{
+	std::lock_guard<std::mutex> lk(m_mu_monitor);
+	if (!m_monitorThread.joinable())
+	{
+		m_bMonitorQuit = false;
+		m_monitorThread = std::thread(&baslerCapture::monitorLoop, this);
+	}
+}
+
+void baslerCapture::stopMonitor()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_mu_monitor);
+		m_bMonitorQuit = true;
+		m_con_v_monitor.notify_one();
+	}
+	if (m_monitorThread.joinable())
+	{
+		m_monitorThread.join();
+	}
+}
+
+// a removed camera is looked for once per interval until it is back
+void baslerCapture::monitorLoop()
+{
+	std::unique_lock<std::mutex> lk(m_mu_monitor);
+	while (!m_bMonitorQuit)
+	{
+		m_con_v_monitor.wait_for(lk, std::chrono::milliseconds(RECONNECT_INTERVAL_MS));
+		if (m_bMonitorQuit)
+		{
+			break;
+		}
+		lk.unlock();
+		std::vector<baslerCam*> cams = getWorkingCameras();
+		for (int i = 0; i < cams.size(); ++i)
+		{
+			if (cams[i]->isLost())
+			{
+				cams[i]->reconnect();
+			}
+		}
+		lk.lock();
+	}
+}
+
+baslerCapture::~baslerCapture()
+{
+	// outstanding captures complete, as cancelled, before their cameras go away
+	cancelWaits();
+	stopMonitor();
+	m_dispatcher.stop();
+	int numLentBuffers = 0;
+	for (int i = 0; i < m_vpWorkingCameras.size(); ++i)
+	{
+		numLentBuffers += m_vpWorkingCameras[i]->getNumLentBuffers();
+		delete m_vpWorkingCameras[i];
+		m_vpWorkingCameras[i] = NULL;
+	}
+	// a lent Mat holds its grab result, which outlives the closed device but not pylon itself
+	if (numLentBuffers > 0)
+	{
+		std::cerr << numLentBuffers << " grab buffers still lent, pylon stays initialized.\n";
+		return;
+	}
+	terminateBaslerCameras();
+}
+
+int baslerCapture::setCurrentState(int state)
+{
+	std::lock_guard<std::mutex> lk(m_mu_state);
+	m_currentState = state;
+	return 0;
+}
+int baslerCapture::getCurrentState()
+{
+	std::lock_guard<std::mutex> lk(m_mu_state);
+	return m_currentState;
+}
+
+int baslerCapture::getNumOfWorkingDevices()
+{
+	std::lock_guard<std::mutex> lk(m_mu_cameras);
+	return m_vpWorkingCameras.size();
+}
+
+std::vector<baslerCam*> baslerCapture::getWorkingCameras()
+{
+	std::lock_guard<std::mutex> lk(m_mu_cameras);
+	return m_vpWorkingCameras;
+}
+
+baslerCam* baslerCapture::getWorkingCamera(int camIdx)
+{
+	std::lock_guard<std::mutex> lk(m_mu_cameras);
+	if (camIdx < 0 || camIdx >= m_vpWorkingCameras.size())
+	{
+		std::cerr << "camIdx = " << camIdx << " out of range.\n";
+		return NULL;
+	}
+	return m_vpWorkingCameras[camIdx];
+}
+
+// Enumerating every transport layer takes seconds on hosts with several NICs,
+// so it only happens here, not when the capture is created.
+std::vector<std::string> baslerCapture::getAvailableSNs()
+{
+	std::vector<std::string> SNlist;
+	DeviceInfoList_t listDeviceInfo;
+	try
 	{
-		if (!m_InstantCamera.IsGrabbing())
+		CTlFactory::GetInstance().EnumerateDevices(listDeviceInfo);
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << "EnumerateDevices fail: " << e.GetDescription() << "\n";
+		return SNlist;
+	}
+	std::cout << "m_nTotalAvailableDeviceNum = " << listDeviceInfo.size() << "\n";
+	for (int i = 0; i < listDeviceInfo.size(); i++)
+	{
+		std::string strDeviceSN = listDeviceInfo[i].GetSerialNumber().c_str();
+		std::cout << "strDeviceSN " << std::to_string(i) << " = " << strDeviceSN << "\n";
+		SNlist.push_back(strDeviceSN);
+	}
+
+	std::lock_guard<std::mutex> lk(m_mu_deviceInfo);
+	m_listDeviceInfo = listDeviceInfo;
+	return SNlist;
+}
+
+int baslerCapture::initBaslerCameras()
+{
+	std::cout << "initBaslerCameras" << "\n";
+	if (g_bPylonAutoInitTerm == false)
+	{
+		Pylon::PylonInitialize();
+		g_bPylonAutoInitTerm = true;
+	}
+	return 0;
+}
+
+
+int baslerCapture::terminateBaslerCameras()
+{
+	if (g_bPylonAutoInitTerm == true)
+	{
+		Pylon::PylonTerminate();
+		g_bPylonAutoInitTerm = false;
+	}
+
+	return 0;
+}
+
+
+// runs on one of the openDevices() threads, touches nothing shared but the device list
+int baslerCapture::createDevice(const std::string &camSN, baslerCam *&p_cam)
+{
+	p_cam = NULL;
+	// reuse the listing of getAvailableSNs() if there is one
+	bool bFound = false;
+	CDeviceInfo info;
+	{
+		std::lock_guard<std::mutex> lk(m_mu_deviceInfo);
+		for (int i = 0; i < m_listDeviceInfo.size() && !bFound; ++i)
 		{
-			std::cout << "m_InstantCamera start capture ..." << "\n";
-			m_InstantCamera.StartGrabbing(GrabStrategy_OneByOne, GrabLoop_ProvidedByInstantCamera);
-			return 0;
+			if (camSN == m_listDeviceInfo[i].GetSerialNumber().c_str())
+			{
+				info = m_listDeviceInfo[i];
+				bFound = true;
+			}
 		}
-		else
+	}
+	// otherwise look up this serial only
+	if (!bFound)
+	{
+		CDeviceInfo filterInfo;
+		filterInfo.SetSerialNumber(camSN.c_str());
+		DeviceInfoList_t filter;
+		filter.push_back(filterInfo);
+		DeviceInfoList_t listDeviceInfo;
+		if (CTlFactory::GetInstance().EnumerateDevices(listDeviceInfo, filter) > 0)
 		{
-			std::cout << "Camera is grabbing already." << "\n";
+			info = listDeviceInfo[0];
+			bFound = true;
 		}
 	}
-	else
+	if (!bFound)
 	{
-		std::cerr << "Camera is not open." << "\n";
+		std::cerr << "camSN = " << camSN << " not found.\n";
+		return -1;
 	}
-	return -1;
+
+	baslerCam* p_newCam = new baslerCam();
+	if (p_newCam->init(info) != 0)
+	{
+		delete p_newCam;
+		return -1;
+	}
+	p_cam = p_newCam;
+	return 0;
 }
 
-int baslerCam::stop()
+int baslerCapture::configurateExposure(float exposureTime)
 {
-	if (m_InstantCamera.IsOpen())
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
 	{
-		if (m_InstantCamera.IsGrabbing())
+		cams[i]->configurateExposure(exposureTime);
+	}
+	return 0;
+}
+int baslerCapture::configuratePixelFormat(const std::string &pixelFormat)
+{
+	int result = 0;
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->configuratePixelFormat(pixelFormat);
+		if (status != 0)
 		{
-			m_InstantCamera.StopGrabbing();
-			return 0;
+			std::cerr << cams[i]->getSerial() << " fails to configuratePixelFormat.\n";
+			result = -1;
 		}
 	}
-	return -1;
+	return result;
 }
+// every camera is configured on its own thread, node writes are bus round trips
+int baslerCapture::configurateCameras(const std::map<std::string, CameraConfig> &configs, std::vector<int> &status)
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	status.assign(cams.size(), 0);
+	std::vector<std::thread> threads;
+	int numOfConfigured = 0;
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		std::map<std::string, CameraConfig>::const_iterator it = configs.find(cams[i]->getSerial());
+		if (it == configs.end())
+		{
+			continue;
+		}
+		numOfConfigured++;
+		threads.push_back(std::thread([&cams, &status, it, i]() {
+			try
+			{
+				status[i] = cams[i]->configurate(it->second);
+			}
+			catch (std::exception &e)
+			{
+				// an exception leaving the thread would terminate the process, fail this camera only
+				std::cerr << cams[i]->getSerial() << " catch at configurate: " << e.what() << "\n";
+				status[i] = -1;
+			}
+		}));
+	}
+	for (int i = 0; i < threads.size(); ++i)
+	{
+		threads[i].join();
+	}
+	if (numOfConfigured < configs.size())
+	{
+		std::cerr << configs.size() - numOfConfigured << " configurations for cameras that are not open.\n";
+	}
 
-int baslerCam::readyHWTrig(int numOfTrig)
+	int result = 0;
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		if (status[i] != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to configurateCameras.\n";
+			result = -1;
+		}
+	}
+	return result;
+}
+int baslerCapture::start()
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->start();
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to start.\n";
+		}
+	}
+	setCurrentState(RUNNING_STATE);
+	return 0;
+}
+int baslerCapture::stop()
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->stop();
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to stop.\n";
+		}
+	}
+	setCurrentState(STOP_STATE);
+	return 0;
+}
+int baslerCapture::readyHWTrig(int numOfTrig)
+{
+	int result = 0;
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->readyHWTrig(numOfTrig);
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to readyHWTrig.\n";
+			result = -1;
+		}
+	}
+	return result;
+}
+// the cv::Mat overloads return the images of the Frame overloads
+static void toImages(const std::vector<Frame> &frames, std::vector<cv::Mat> &imgs)
 {
-	std::lock_guard<std::mutex> lk(g_mu_Grab);
+	imgs.clear();
+	for (int i = 0; i < frames.size(); ++i)
+	{
+		imgs.push_back(frames[i].image);
+	}
+}
 
-	//--- set number of image to cache---
-	m_Cache.setNumOfImage(numOfTrig);
+int baslerCapture::getHWTrigImgs(std::vector<cv::Mat> &imgs)
+{
+	std::vector<Frame> frames;
+	int status = getHWTrigImgs(frames);
+	toImages(frames, imgs);
+	return status;
+}
+int baslerCapture::getHWTrigImgs(std::vector<Frame> &frames)
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	frames.clear();
+	// every camera is collected, so none stays armed and partial bursts are not lost.
+	// One deadline for all cameras, the ones missing a trigger time out together.
+	std::chrono::steady_clock::time_point deadline = getDeadline(cams);
+	int result = 0;
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		std::vector<Frame> frames_per_cam;
+		int status = cams[i]->getHWTrigImgs(frames_per_cam, deadline);
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to getHWTrigImgs.\n";
+			result = status;
+		}
+		frames.insert(frames.end(), frames_per_cam.begin(), frames_per_cam.end());
+	}
+	return result;
+}
+int baslerCapture::getHWTrigFrameSets(std::vector<FrameSet> &sets, int syncMode, int64_t tolerance)
+{
+	if (syncMode != SYNC_TIMESTAMP && syncMode != SYNC_RELATIVE_TIMESTAMP && syncMode != SYNC_FRAME_NUMBER)
+	{
+		std::cerr << "unknown sync mode " << syncMode << ".\n";
+		return -1;
+	}
 
-	//--- set hw trigger mode ----
-	CEnumerationPtr triggerMode(m_InstantCamera.GetNodeMap().GetNode("TriggerSource"));
-	triggerMode->FromString("Line1");
-	m_IsHWtriggerRunning = true;
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	sets.clear();
+	FrameSynchronizer synchronizer((int)cams.size(), syncMode, tolerance);
+	// one deadline for all cameras, the ones missing a trigger time out together
+	std::chrono::steady_clock::time_point deadline = getDeadline(cams);
+	int result = 0;
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		// a camera that missed a trigger times out but keeps the frames it got
+		std::vector<Frame> frames_per_cam;
+		int status = cams[i]->getHWTrigImgs(frames_per_cam, deadline);
+		if (frames_per_cam.empty())
+		{
+			std::cerr << cams[i]->getSerial() << " fails to getHWTrigFrameSets.\n";
+			result = status;
+		}
+		for (int j = 0; j < frames_per_cam.size(); ++j)
+		{
+			synchronizer.push(frames_per_cam[j]);
+		}
+	}
+	synchronizer.flush(sets);
+	return result;
+}
+int baslerCapture::startHWTrigStream(int queueSize)
+{
+	if (queueSize <= 0)
+	{
+		std::cerr << "queueSize = " << queueSize << " invalid.\n";
+		return -1;
+	}
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->startHWTrigStream(queueSize);
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to startHWTrigStream.\n";
+			std::vector<Frame> stale;
+			for (int j = 0; j < i; ++j)
+			{
+				cams[j]->stopHWTrigStream(stale);
+			}
+			return -1;
+		}
+	}
+	return 0;
+}
+int baslerCapture::readHWTrigStream(std::vector<Frame> &frames, int maxFrames, int timeoutMs)
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	frames.clear();
+	// one deadline for all cameras, so the call returns within timeoutMs
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	int result = 0;
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->readHWTrigStream(frames, maxFrames, deadline);
+		if (status < 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to readHWTrigStream.\n";
+			result = status;
+		}
+		else if (status > 0 && result == 0)
+		{
+			result = 1;
+		}
+	}
+	return result;
+}
+int baslerCapture::stopHWTrigStream(std::vector<Frame> &frames)
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	frames.clear();
+	int result = 0;
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->stopHWTrigStream(frames);
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to stopHWTrigStream.\n";
+			result = -1;
+		}
+	}
+	return result;
+}
+int baslerCapture::getNumOfDroppedFrames(std::vector<int64_t> &numDropped)
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	numDropped.clear();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		numDropped.push_back(cams[i]->getNumOfDroppedFrames());
+	}
+	return 0;
+}
+int baslerCapture::setTimeout(int timeoutMs)
+{
+	if (timeoutMs < 0)
+	{
+		std::cerr << "timeoutMs = " << timeoutMs << " invalid.\n";
+		return -1;
+	}
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		cams[i]->setTimeout(timeoutMs);
+	}
+	return 0;
+}
+int baslerCapture::cancelWaits()
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		cams[i]->cancelWaits();
+	}
+	return 0;
+}
+int baslerCapture::setSWTrigMode(int mode)
+{
+	if (mode != SWTRIG_SEQUENTIAL && mode != SWTRIG_CONCURRENT)
+	{
+		std::cerr << "unknown software trigger mode " << mode << ".\n";
+		return -1;
+	}
+	m_swTrigMode = mode;
+	return 0;
+}
+int baslerCapture::ExecuteSWTrig(std::vector<cv::Mat> &imgs)
+{
+	std::vector<Frame> frames;
+	int status = ExecuteSWTrig(frames);
+	toImages(frames, imgs);
+	return status;
+}
+int baslerCapture::ExecuteSWTrig(std::vector<Frame> &frames)
+{
+	if (m_swTrigMode == SWTRIG_CONCURRENT)
+	{
+		return ExecuteSWTrigConcurrent(frames);
+	}
 
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	frames.clear();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		Frame frame_per_cam;
+		int status = cams[i]->ExecuteSWTrig(frame_per_cam);
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to ExecuteSWTrig.\n";
+			return status;
+		}
+		frames.push_back(frame_per_cam);
+	}
 	return 0;
 }
-
-int baslerCam::getHWTrigImgs(std::vector<cv::Mat> &imgs)
+
+int baslerCapture::ExecuteSWTrigConcurrent(std::vector<Frame> &frames)
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	frames.clear();
+
+	// hold every camera for the whole snapshot, always locked in the same order
+	std::vector<std::unique_lock<std::mutex> > locks;
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		locks.push_back(cams[i]->lockGrab());
+	}
+
+	// arm every camera before the first trigger goes out
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->armSWTrig();
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to ExecuteSWTrig.\n";
+			for (int j = 0; j < i; ++j)
+			{
+				cams[j]->disarmSWTrig();
+			}
+			return status;
+		}
+	}
+
+	// fire back-to-back so that all cameras expose together
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->fireSWTrig();
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to ExecuteSWTrig.\n";
+			for (int j = 0; j < cams.size(); ++j)
+			{
+				cams[j]->disarmSWTrig();
+			}
+			return status;
+		}
+	}
+
+	// frames are already in flight on all cameras, collecting them in turn
+	// costs no more than the slowest camera
+	int result = 0;
+	std::chrono::steady_clock::time_point deadline = getDeadline(cams);
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		Frame frame_per_cam;
+		int status = cams[i]->collectSWTrig(frame_per_cam, deadline);
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to ExecuteSWTrig.\n";
+			result = status;
+		}
+		frames.push_back(frame_per_cam);
+	}
+	if (result != 0)
+	{
+		frames.clear();
+	}
+	return result;
+}
+
+int baslerCapture::readyHWTrig(int camIdx, int numOfTrig)
+{
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
+	{
+		return -1;
+	}
+	return p_cam->readyHWTrig(numOfTrig);
+}
+int baslerCapture::getHWTrigImgs(int camIdx, std::vector<cv::Mat> &imgs)
+{
+	std::vector<Frame> frames;
+	int status = getHWTrigImgs(camIdx, frames);
+	toImages(frames, imgs);
+	return status;
+}
+int baslerCapture::getHWTrigImgs(int camIdx, std::vector<Frame> &frames)
+{
+	frames.clear();
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
+	{
+		return -1;
+	}
+	return p_cam->getHWTrigImgs(frames, p_cam->getDeadline());
+}
+int baslerCapture::readHWTrigStream(int camIdx, std::vector<Frame> &frames, int maxFrames, int timeoutMs)
 {
-	std::lock_guard<std::mutex> lk(g_mu_Grab);
-	int status = 0;
-
-	if (!m_IsHWtriggerRunning)
+	frames.clear();
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
 	{
-		std::cerr << "Not hardwareTrigger Ready.Please ReadyHWTrig before calling this function.\n";
 		return -1;
 	}
-
-	//--- get images ----
-	std::vector<cv::Mat> _imgs;
-	status = m_Cache.getImages(_imgs);
-	if (status != 0)
+	return p_cam->readHWTrigStream(frames, maxFrames, std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs));
+}
+int baslerCapture::setTimeout(int camIdx, int timeoutMs)
+{
+	if (timeoutMs < 0)
 	{
-		std::cerr << "get images fail.\n";
+		std::cerr << "timeoutMs = " << timeoutMs << " invalid.\n";
 		return -1;
 	}
-
-	if (_imgs.size() == 0)
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
 	{
-		std::cerr << "image invalid.\n";
 		return -1;
 	}
-
-	if (_imgs[0].empty())
+	return p_cam->setTimeout(timeoutMs);
+}
+int baslerCapture::isDeviceLost(int camIdx)
+{
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
 	{
-		std::cerr << "image invalid.\n";
 		return -1;
 	}
-
-	imgs = _imgs;
-	m_IsHWtriggerRunning = false;
-	return 0;
+	return p_cam->isLost() ? 1 : 0;
 }
-
-int baslerCam::ExecuteSWTrig(cv::Mat& img)
+int baslerCapture::configurateStream(int camIdx, const StreamConfig &config)
 {
-	std::lock_guard<std::mutex> lk(g_mu_Grab);
-	int status = 0;
-	if (m_IsHWtriggerRunning)
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
 	{
-		return 1;
+		return -1;
 	}
-
-	//--- set number of image to cache---
-	m_Cache.setNumOfImage(1);
-
-	// ---set softwaretrigger mode ---
-	CEnumerationPtr triggerMode(m_InstantCamera.GetNodeMap().GetNode("TriggerSource"));
-	triggerMode->FromString("Software");
-
-	// --- trigger execute
-	CEnumerationPtr triggerSelector(m_InstantCamera.GetNodeMap().GetNode("TriggerSelector"));
-	CCommandPtr SoftExecute(m_InstantCamera.GetNodeMap().GetNode("TriggerSoftware"));
-	if (IsWritable(SoftExecute))
+	return p_cam->configurateStream(config);
+}
+int baslerCapture::getStreamStatus(int camIdx, StreamStatus &status)
+{
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
 	{
-		SoftExecute->Execute();
+		return -1;
 	}
-
-	std::vector<cv::Mat> imgs;
-	status = m_Cache.getImages(imgs);
-	if (status != 0)
+	return p_cam->getStreamStatus(status);
+}
+int baslerCapture::ExecuteSWTrig(int camIdx, cv::Mat &img)
+{
+	Frame frame;
+	int status = ExecuteSWTrig(camIdx, frame);
+	img = frame.image;
+	return status;
+}
+int baslerCapture::ExecuteSWTrig(int camIdx, Frame &frame)
+{
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
 	{
-		std::cerr << "get images fail.\n";
 		return -1;
 	}
+	return p_cam->ExecuteSWTrig(frame);
+}
 
-	if (imgs.size() == 0)
+int baslerCapture::setDemosaicMode(int camIdx, int mode)
+{
+	if (mode != DEMOSAIC_PYLON && mode != DEMOSAIC_BILINEAR && mode != DEMOSAIC_SUPERPIXEL)
 	{
-		std::cerr << "image invalid.\n";
+		std::cerr << "unknown demosaic mode " << mode << ".\n";
 		return -1;
 	}
-
-	if (imgs[0].empty())
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
 	{
-		std::cerr << "image invalid.\n";
 		return -1;
 	}
-
-	img = imgs[0];
-	return 0;
+	return p_cam->setDemosaicMode(mode);
 }
 
-
-/****************************************
-
-baslerCapture
-
-*****************************************/
-class baslerCapture : public baslerCaptureItf
-{
-public:
-	baslerCapture();
-	virtual ~baslerCapture();
-
-	std::vector<std::string> getAvailableSNs();
-	int openDevices(const std::vector<std::string> &camSNs);
-	int getNumOfWorkingDevices();
-	int configurateExposure(float exposureTime); // microsec
-	int start();
-	int stop();
-	int readyHWTrig(int numOfTrig);
-	int getHWTrigImgs(std::vector<cv::Mat> &imgs);
-	int ExecuteSWTrig(std::vector<cv::Mat> &imgs);
-	int getCurrentState();
-	
-private:
-	int initBaslerCameras();
-	int terminateBaslerCameras();
-
-	int addDevice(const std::string &camSN);
-	int setCurrentState(int state);
-private:
-	// Camera Devices
-	bool m_isInited = false;
-	int m_nTotalDeviceNum = 0;
-	int m_currentState = STOP_STATE;
-	Pylon::DeviceInfoList_t m_listDeviceInfo;
-
-	std::vector<baslerCam*> m_vpWorkingCameras;
-
-};
-baslerCapture::baslerCapture() 
+int baslerCapture::setGrabStrategy(int camIdx, int strategy, int numImages)
 {
-	try
+	if (strategy != GRAB_ONE_BY_ONE && strategy != GRAB_LATEST_IMAGE_ONLY && strategy != GRAB_LATEST_IMAGES && strategy != GRAB_UPCOMING_IMAGE)
 	{
-		initBaslerCameras();
+		std::cerr << "unknown grab strategy " << strategy << ".\n";
+		return -1;
 	}
-	catch (GenICam::GenericException &e)
+	if (strategy == GRAB_LATEST_IMAGES && numImages < 1)
 	{
-		char buff[1024];
-		snprintf(buff, sizeof(buff), "Catch Exception InitAll() error: %s", e.GetDescription());
-		std::string str;
-		str = buff;
-		std::cout << str << "\n";
+		std::cerr << "GRAB_LATEST_IMAGES needs numImages >= 1.\n";
+		return -1;
+	}
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
+	{
+		return -1;
 	}
+	return p_cam->setGrabStrategy(strategy, numImages);
 }
 
-
-int baslerCapture::openDevices(const std::vector<std::string> &camSNs)
+int baslerCapture::setGrabThread(int camIdx, const GrabThreadConfig &config)
 {
-	try
+	if (config.realtimePriority < 0 || config.realtimePriority > 99 || config.nice < -20 || config.nice > 19)
 	{
-		for (int i = 0; i < camSNs.size(); ++i)
-		{
-			addDevice(camSNs[i]);
-		}
+		std::cerr << "grab thread priority out of range.\n";
+		return -1;
 	}
-	catch (GenICam::GenericException &e)
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
 	{
-		char buff[1024];
-		snprintf(buff, sizeof(buff), "Catch Exception OpenDevice: %s", e.GetDescription());
-		std::string str;
-		str = buff;
-		std::cout << str << "\n";
 		return -1;
 	}
-	return 0;
+	return p_cam->setGrabThread(config);
 }
 
-baslerCapture::~baslerCapture()
+int baslerCapture::setChunks(int camIdx, int chunks)
 {
-	for (int i = 0; i < m_vpWorkingCameras.size(); ++i)
+	const int allChunks = CHUNK_EXPOSURE_TIME | CHUNK_GAIN | CHUNK_LINE_STATUS | CHUNK_TRIGGER_COUNTER | CHUNK_TIMESTAMP;
+	if ((chunks & ~allChunks) != 0)
 	{
-		delete m_vpWorkingCameras[i];
-		m_vpWorkingCameras[i] = NULL;
+		std::cerr << "unknown chunks " << chunks << ".\n";
+		return -1;
 	}
-	terminateBaslerCameras();
-}
-
-int baslerCapture::setCurrentState(int state)
-{
-	std::lock_guard<std::mutex> lk(g_mu_state);
-	m_currentState = state;
-	return 0;
-}
-int baslerCapture::getCurrentState()
-{
-	std::lock_guard<std::mutex> lk(g_mu_state);
-	return m_currentState;
-}
-
-int baslerCapture::getNumOfWorkingDevices()
-{
-	return m_vpWorkingCameras.size();
-}
-
-std::vector<std::string> baslerCapture::getAvailableSNs()
-{
-	std::vector<std::string> SNlist;
-	for (int i = 0; i < m_nTotalDeviceNum; i++)
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL)
 	{
-		DeviceInfoList_t::iterator it = m_listDeviceInfo.begin() + i;
-		std::string strDeviceSN = (*it).GetSerialNumber().c_str();
-		std::cout << "strDeviceSN " << std::to_string(i) << " = " << strDeviceSN << "\n";
-		SNlist.push_back(strDeviceSN);
+		return -1;
 	}
-	return SNlist;
+	return p_cam->setChunks(chunks);
 }
 
-int baslerCapture::initBaslerCameras()
+int baslerCapture::setAcquisitionMode(int mode)
 {
-	std::cout << "initBaslerCameras" << "\n";
-	if (g_bPylonAutoInitTerm == false)
+	if (mode != ACQ_TRIGGERED && mode != ACQ_CONTINUOUS)
 	{
-		Pylon::PylonInitialize();
-		g_bPylonAutoInitTerm = true;
+		std::cerr << "unknown acquisition mode " << mode << ".\n";
+		return -1;
 	}
 
-	Pylon::CTlFactory& tlFactory = CTlFactory::GetInstance();
-
-	//Get Device total view
-	DeviceInfoList_t listDeviceInfo;
-	int nTotalDeviceNum = tlFactory.EnumerateDevices(listDeviceInfo);
-	std::cout << "m_nTotalAvailableDeviceNum = " << nTotalDeviceNum << "\n";
-	m_nTotalDeviceNum = nTotalDeviceNum;
-	m_listDeviceInfo = listDeviceInfo;
-
-	//Print SN from device list
-	getAvailableSNs();
-
-	return 0;
+	int result = 0;
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		int status = cams[i]->setContinuous(mode == ACQ_CONTINUOUS);
+		if (status != 0)
+		{
+			std::cerr << cams[i]->getSerial() << " fails to setAcquisitionMode.\n";
+			result = -1;
+		}
+	}
+	return result;
 }
-
-
-int baslerCapture::terminateBaslerCameras()
+int baslerCapture::getLatestImages(std::vector<cv::Mat> &imgs)
 {
-	if (g_bPylonAutoInitTerm == true)
+	std::vector<Frame> frames;
+	int status = getLatestImages(frames);
+	toImages(frames, imgs);
+	return status;
+}
+int baslerCapture::getLatestImages(std::vector<Frame> &frames)
+{
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	frames.clear();
+	for (int i = 0; i < cams.size(); ++i)
 	{
-		Pylon::PylonTerminate();
-		g_bPylonAutoInitTerm = false;
+		Frame frame_per_cam;
+		int status = cams[i]->getLatestImage(frame_per_cam);
+		if (status != 0)
+		{
+			return -1;
+		}
+		frames.push_back(frame_per_cam);
 	}
-
 	return 0;
 }
 
-
-int baslerCapture::addDevice(const std::string &camSN)
+// the callback is called once, on the dispatcher thread
+int baslerCapture::postCapture(const std::vector<baslerCam*> &cams, const CaptureCallback &callback)
 {
-	int status = 0;
-	// locate camera index
-	int camIdx = -1;
-	for (int i = 0; i < m_listDeviceInfo.size(); ++i)
-	{
-		std::string s1(m_listDeviceInfo[i].GetSerialNumber().c_str());
-		if (s1 == camSN)
+	std::shared_ptr<std::vector<std::vector<Frame> > > pFrames = std::make_shared<std::vector<std::vector<Frame> > >(cams.size());
+	std::shared_ptr<std::vector<int> > pStatus = std::make_shared<std::vector<int> >(cams.size(), 1);
+	CaptureDispatcher::Job job = [cams, pFrames, pStatus, callback](bool bTimedOut) {
+		bool bDone = true;
+		for (int i = 0; i < cams.size(); ++i)
 		{
-			camIdx = i;
+			if ((*pStatus)[i] == 1)
+			{
+				(*pStatus)[i] = cams[i]->pollAsync((*pFrames)[i], bTimedOut);
+				bDone = bDone && (*pStatus)[i] != 1;
+			}
+		}
+		if (!bDone)
+		{
+			return false;
 		}
-	}
-	if (camIdx == -1)
-	{
-		std::cerr << "camSN = " << camSN << "not found.\n";
-		return -1;
-	}
 
-	baslerCam* p_cam = new baslerCam();
-	if (p_cam != NULL)
-	{
-		status = p_cam->init(m_listDeviceInfo[camIdx]);
-		if (status == 0)
+		// frames in camera order, as the blocking calls return them
+		CaptureResult result;
+		result.status = 0;
+		for (int i = 0; i < cams.size(); ++i)
+		{
+			if ((*pStatus)[i] != 0)
+			{
+				std::cerr << cams[i]->getSerial() << " fails to capture.\n";
+				result.status = (*pStatus)[i];
+			}
+			result.frames.insert(result.frames.end(), (*pFrames)[i].begin(), (*pFrames)[i].end());
+		}
+		// frames that did arrive are kept along with the failing status, like getHWTrigImgs()
+		toImages(result.frames, result.imgs);
+		try
 		{
-			m_vpWorkingCameras.push_back(p_cam);
+			callback(result);
 		}
-	}
-	
+		catch (std::exception &e)
+		{
+			std::cerr << "catch at capture callback: " << e.what() << "\n";
+		}
+		return true;
+	};
+	m_dispatcher.post(job, getDeadline(cams));
 	return 0;
 }
 
-int baslerCapture::configurateExposure(float exposureTime)
+// A capture on several cameras waits as long as its most patient camera, once for all of them
+std::chrono::steady_clock::time_point baslerCapture::getDeadline(const std::vector<baslerCam*> &cams)
 {
-	for (int i = 0; i < m_vpWorkingCameras.size(); ++i)
+	int timeoutMs = 0;
+	for (int i = 0; i < cams.size(); ++i)
 	{
-		m_vpWorkingCameras[i]->configurateExposure(exposureTime);
+		timeoutMs = std::max(timeoutMs, cams[i]->getTimeout());
 	}
-	return 0;
+	return std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
 }
-int baslerCapture::start()
+
+int baslerCapture::ExecuteSWTrigAsync(const CaptureCallback &callback)
 {
-	for (int i = 0; i < m_vpWorkingCameras.size(); ++i)
+	std::vector<baslerCam*> cams = getWorkingCameras();
+
+	// arm every camera before the first trigger goes out, then fire back-to-back
+	for (int i = 0; i < cams.size(); ++i)
 	{
-		int status = m_vpWorkingCameras[i]->start();
+		std::unique_lock<std::mutex> lk = cams[i]->lockGrab();
+		int status = cams[i]->armSWTrig();
+		if (status == 0)
+		{
+			status = cams[i]->beginAsync(false);
+		}
 		if (status != 0)
 		{
-			std::cerr << m_vpWorkingCameras[i]->getSerial() << " fails to start.\n";
+			std::cerr << cams[i]->getSerial() << " fails to ExecuteSWTrigAsync.\n";
+			lk.unlock();
+			for (int j = 0; j < i; ++j)
+			{
+				cams[j]->abortAsync();
+			}
+			return -1;
 		}
 	}
-	setCurrentState(RUNNING_STATE);
-	return 0;
+	for (int i = 0; i < cams.size(); ++i)
+	{
+		std::unique_lock<std::mutex> lk = cams[i]->lockGrab();
+		cams[i]->fireSWTrig();
+	}
+	return postCapture(cams, callback);
 }
-int baslerCapture::stop()
+
+int baslerCapture::getHWTrigImgsAsync(const CaptureCallback &callback)
 {
-	for (int i = 0; i < m_vpWorkingCameras.size(); ++i)
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
 	{
-		int status = m_vpWorkingCameras[i]->stop();
+		std::unique_lock<std::mutex> lk = cams[i]->lockGrab();
+		int status = cams[i]->beginAsync(true);
 		if (status != 0)
 		{
-			std::cerr << m_vpWorkingCameras[i]->getSerial() << " fails to stop.\n";
+			std::cerr << cams[i]->getSerial() << " fails to getHWTrigImgsAsync.\n";
+			lk.unlock();
+			for (int j = 0; j < i; ++j)
+			{
+				cams[j]->abortAsync();
+			}
+			return -1;
 		}
 	}
-	setCurrentState(STOP_STATE);
-	return 0;
+	return postCapture(cams, callback);
 }
-int baslerCapture::readyHWTrig(int numOfTrig)
+
+// a capture that cannot start completes the future right away with status -1
+static std::future<CaptureResult> captureFuture(std::function<int(const CaptureCallback &)> start)
 {
-	for (int i = 0; i < m_vpWorkingCameras.size(); ++i)
+	std::shared_ptr<std::promise<CaptureResult> > pPromise = std::make_shared<std::promise<CaptureResult> >();
+	std::future<CaptureResult> future = pPromise->get_future();
+	int status = start([pPromise](const CaptureResult &result) {
+		pPromise->set_value(result);
+	});
+	if (status != 0)
 	{
-		int status = m_vpWorkingCameras[i]->readyHWTrig(numOfTrig);
-		if (status != 0)
-		{
-			std::cerr << m_vpWorkingCameras[i]->getSerial() << " fails to readyHWTrig.\n";
-		}
+		CaptureResult result;
+		result.status = -1;
+		pPromise->set_value(result);
 	}
-	return 0;
+	return future;
 }
-int baslerCapture::getHWTrigImgs(std::vector<cv::Mat> &imgs)
+
+std::future<CaptureResult> baslerCapture::ExecuteSWTrigAsync()
 {
-	imgs.clear();
-	for (int i = 0; i < m_vpWorkingCameras.size(); ++i)
+	return captureFuture([this](const CaptureCallback &callback) {
+		return ExecuteSWTrigAsync(callback);
+	});
+}
+
+std::future<CaptureResult> baslerCapture::getHWTrigImgsAsync()
+{
+	return captureFuture([this](const CaptureCallback &callback) {
+		return getHWTrigImgsAsync(callback);
+	});
+}
+
+int baslerCapture::subscribe(int camIdx, const FrameCallback &callback, int dispatch)
+{
+	if (dispatch != DISPATCH_INLINE && dispatch != DISPATCH_WORKER)
 	{
-		std::vector<cv::Mat> imgs_per_cam;
-		int status = m_vpWorkingCameras[i]->getHWTrigImgs(imgs_per_cam);
-		if (status != 0)
-		{
-			std::cerr << m_vpWorkingCameras[i]->getSerial() << " fails to getHWTrigImgs.\n";
-			return -1;
-		}
-		imgs.insert(imgs.end(), imgs_per_cam.begin(), imgs_per_cam.end());
+		std::cerr << "unknown dispatch " << dispatch << ".\n";
+		return -1;
 	}
-	return 0;
+	baslerCam* p_cam = getWorkingCamera(camIdx);
+	if (p_cam == NULL || !callback)
+	{
+		return -1;
+	}
+
+	int id = m_nextSubscriptionId.fetch_add(1);
+	if (p_cam->subscribe(id, callback, dispatch) != 0)
+	{
+		return -1;
+	}
+	return id;
 }
-int baslerCapture::ExecuteSWTrig(std::vector<cv::Mat> &imgs)
+
+int baslerCapture::unsubscribe(int subscriptionId)
 {
-	imgs.clear();
-	for (int i = 0; i < m_vpWorkingCameras.size(); ++i)
+	std::vector<baslerCam*> cams = getWorkingCameras();
+	for (int i = 0; i < cams.size(); ++i)
 	{
-		cv::Mat img_per_cam;
-		int status = m_vpWorkingCameras[i]->ExecuteSWTrig(img_per_cam);
-		if (status != 0)
+		if (cams[i]->unsubscribe(subscriptionId) == 0)
 		{
-			std::cerr << m_vpWorkingCameras[i]->getSerial() << " fails to ExecuteSWTrig.\n";
-			return -1;
+			return 0;
 		}
-		imgs.push_back(img_per_cam);
 	}
-	return 0;
+	std::cerr << "subscription " << subscriptionId << " not found.\n";
+	return -1;
 }
 
 std::shared_ptr<baslerCaptureItf> createBaslerCapture()
 {
 	return std::make_shared<baslerCapture>();
-}
\ No newline at end of file
+}
@@ -8,6 +8,110 @@
 #pragma once
 #include <opencv2/opencv.hpp>
 #include <memory>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <string>
+#include <map>
+#include <stdint.h>
+
+// Values the camera sent along with the image, see setChunks(). Chunks not enabled stay at -1.
+struct FrameChunks
+{
+	double exposureTime = -1;     // microsec, as used for this image
+	double gain = -1;             // dB
+	int64_t lineStatusAll = -1;   // I/O line levels at exposure start, bit 0 is Line1
+	int64_t triggerCounter = -1;  // frame triggers counted by the camera's Counter1
+	int64_t timestamp = -1;       // camera clock at exposure start
+};
+
+// A grabbed image with the grab result data it came with.
+struct Frame
+{
+	cv::Mat image;               // may share the grab buffer, see getHWTrigImgs()
+	std::string camSN;
+	int camIdx = -1;             // order of openDevices()
+	uint64_t timestamp = 0;      // camera clock at exposure start, in ticks of the camera (ns on USB3 cameras)
+	uint64_t blockID = 0;        // stream block id, a gap means frames were lost on the way to the host
+	int64_t imageNumber = 0;     // images grabbed by this camera since the grab started
+	int64_t numSkipped = 0;      // images skipped by the grab strategy right before this one
+	double exposureTime = 0;     // microsec, as configured when the frame arrived
+	std::chrono::steady_clock::time_point hostTime; // when the host received the frame
+	FrameChunks chunks;
+};
+
+// Frames of all cameras that belong to the same trigger, see getHWTrigFrameSets().
+struct FrameSet
+{
+	std::vector<Frame> frames;  // indexed by camIdx, an empty image where the camera had no frame
+	std::vector<bool> present;  // false where the camera had no frame within tolerance
+	bool complete = false;      // every camera present
+	int64_t key = 0;            // timestamp or frame counter the set was matched on
+};
+
+// Settings of one camera, see configurateCameras(). Fields left at their defaults are not written.
+struct CameraConfig
+{
+	std::string featureFile;         // pylon feature file (.pfs) saved from the camera, loaded before the fields below
+	float exposureTime = -1;         // microsec
+	double gain = -1;                // dB
+	int offsetX = -1;                // ROI in pixels, within the camera's increments
+	int offsetY = -1;
+	int width = -1;
+	int height = -1;
+	std::string pixelFormat;         // see configuratePixelFormat()
+	std::string triggerLine;         // hardware trigger input, "Line1" until set
+	std::string triggerActivation;   // e.g. "RisingEdge", "FallingEdge"
+	double triggerDelay = -1;        // microsec
+};
+
+// Grab buffer and transport settings of one camera, see configurateStream(). Fields left at -1 are not written.
+struct StreamConfig
+{
+	int maxNumBuffer = -1;      // grab buffers; unless set here, readyHWTrig() raises it to fit the burst
+	int maxBufferSize = -1;     // bytes per grab buffer
+	int maxTransferSize = -1;   // USB: bytes per transfer request
+	int numMaxQueuedUrbs = -1;  // USB: transfer requests queued in the driver
+	int outputQueueSize = -1;   // grabbed buffers kept by GRAB_LATEST_IMAGES, see setGrabStrategy()
+};
+
+// Buffer counts of one camera at the time of getStreamStatus().
+struct StreamStatus
+{
+	int maxNumBuffer = 0;
+	int numQueuedBuffers = 0;        // handed to the driver, waiting for image data
+	int numReadyBuffers = 0;         // filled, waiting for the grab loop
+	int numEmptyBuffers = 0;         // neither of the above
+	int numLentBuffers = 0;          // held by frames passed on without a copy
+	int numCachedFrames = 0;         // frames waiting to be collected by a capture
+	int64_t numDroppedFrames = 0;    // see getNumOfDroppedFrames()
+	int64_t numBufferUnderruns = -1; // stream grabber statistics, -1 where the transport layer has none
+	int64_t numFailedBuffers = -1;
+};
+
+// Thread that takes frames from pylon for one camera, see setGrabThread().
+struct GrabThreadConfig
+{
+	bool bOwnThread = false;    // RetrieveResult on a thread of this library instead of pylon's grab loop thread
+	std::vector<int> cpus;      // cores the own thread may run on, empty for any
+	int realtimePriority = 0;   // 1..99 for SCHED_FIFO (Windows: time critical), 0 for the normal scheduler
+	int nice = 0;               // -20..19 under the normal scheduler
+};
+
+struct CaptureResult
+{
+	int status = -1; // 0 on success; on failure imgs and frames hold what did arrive
+	std::vector<cv::Mat> imgs;
+	std::vector<Frame> frames; // same images, with their metadata
+};
+
+// Called once per asynchronous capture, on the capture's dispatcher thread.
+// Keep it short, other captures complete on the same thread. It must not destroy the capture.
+// Exceptions thrown by it are caught and logged.
+typedef std::function<void(const CaptureResult &result)> CaptureCallback;
+
+// Receives every frame a subscribed camera grabs, see baslerCaptureItf::subscribe().
+typedef std::function<void(const Frame &frame)> FrameCallback;
 
 
 class baslerCaptureItf
@@ -17,17 +121,199 @@ public:
 	static const int RUNNING_STATE = 1;
 	static const int STOP_STATE = 0;
 
+	// SWTRIG_SEQUENTIAL triggers and reads one camera after the other.
+	// SWTRIG_CONCURRENT triggers all cameras back-to-back, then gathers the frames.
+	static const int SWTRIG_SEQUENTIAL = 0;
+	static const int SWTRIG_CONCURRENT = 1;
+
+	// ACQ_TRIGGERED delivers frames on software or hardware triggers only.
+	// ACQ_CONTINUOUS turns the trigger off, the cameras run at their own frame rate
+	// and getLatestImages() returns the newest frame of each camera without waiting.
+	static const int ACQ_TRIGGERED = 0;
+	static const int ACQ_CONTINUOUS = 1;
+
+	// Bayer to BGR on colour cameras.
+	// DEMOSAIC_PYLON uses the pylon converter (default).
+	// DEMOSAIC_BILINEAR is a full resolution bilinear interpolation, faster than the converter.
+	// DEMOSAIC_SUPERPIXEL turns every 2x2 cell into one pixel, images are half width and height.
+	static const int DEMOSAIC_PYLON = 0;
+	static const int DEMOSAIC_BILINEAR = 1;
+	static const int DEMOSAIC_SUPERPIXEL = 2;
+
+	// Which frames a camera delivers when the consumer is slower than the camera, see setGrabStrategy().
+	// GRAB_ONE_BY_ONE delivers every frame in order; when the frame queue is full, new frames are dropped (default).
+	// GRAB_LATEST_IMAGE_ONLY keeps only the newest grabbed buffer, older ones are skipped before conversion.
+	// GRAB_LATEST_IMAGES keeps the newest numImages grabbed buffers.
+	// GRAB_UPCOMING_IMAGE grabs only while a frame is requested, so it never returns one taken earlier.
+	//   Not supported by USB cameras.
+	// Except for GRAB_ONE_BY_ONE, a full frame queue overwrites its oldest frame instead.
+	static const int GRAB_ONE_BY_ONE = 0;
+	static const int GRAB_LATEST_IMAGE_ONLY = 1;
+	static const int GRAB_LATEST_IMAGES = 2;
+	static const int GRAB_UPCOMING_IMAGE = 3;
+
+	// Chunks the camera appends to each image, combined with | for setChunks().
+	static const int CHUNK_EXPOSURE_TIME = 1;
+	static const int CHUNK_GAIN = 2;
+	static const int CHUNK_LINE_STATUS = 4;
+	static const int CHUNK_TRIGGER_COUNTER = 8;
+	static const int CHUNK_TIMESTAMP = 16;
+
+	// How subscribe() delivers frames.
+	// DISPATCH_INLINE calls back on the camera's grab thread as soon as the frame is converted.
+	//   Lowest latency, but the camera grabs nothing else until the callback returns.
+	// DISPATCH_WORKER queues the frame to a thread owned by the subscription. Up to 4 frames
+	//   are queued, the oldest is dropped when the callback falls behind.
+	static const int DISPATCH_INLINE = 0;
+	static const int DISPATCH_WORKER = 1;
+
+	// What getHWTrigFrameSets() matches frames on.
+	// SYNC_TIMESTAMP compares device timestamps, for cameras with synchronized clocks (PTP).
+	// SYNC_RELATIVE_TIMESTAMP compares timestamps relative to each camera's first frame of the burst.
+	// SYNC_FRAME_NUMBER compares device-side counters relative to each camera's first frame of the burst:
+	//   the trigger counter chunk where enabled (CHUNK_TRIGGER_COUNTER, see setChunks()), which also
+	//   counts triggers the camera skipped, otherwise the stream block id, which shows frames lost
+	//   on the way to the host. Frame::imageNumber counts received frames and is not used.
+	// The relative modes assume the first trigger of a burst reached every camera.
+	static const int SYNC_TIMESTAMP = 0;
+	static const int SYNC_RELATIVE_TIMESTAMP = 1;
+	static const int SYNC_FRAME_NUMBER = 2;
+
+	// Status of calls that wait for frames, besides 0 and -1.
+	// CAPTURE_TIMEOUT: the frames did not arrive within the camera's timeout, see setTimeout().
+	// CAPTURE_CANCELLED: cancelWaits() or stop() interrupted the wait.
+	static const int CAPTURE_TIMEOUT = -2;
+	static const int CAPTURE_CANCELLED = -3;
+
+	// Enumerates all transport layers, which can take seconds. Not needed to open known serials:
+	// openDevices() looks up any serial not listed by an earlier call directly.
 	virtual std::vector<std::string> getAvailableSNs() = 0;
 	virtual int openDevices(const std::vector<std::string> &camSNs) = 0;
+	// Opens the cameras concurrently. status[i] is 0 when camSNs[i] opened, -1 otherwise;
+	// camIdx follows camSNs with the failed cameras left out. Returns -1 if any camera failed.
+	virtual int openDevices(const std::vector<std::string> &camSNs, std::vector<int> &status) = 0;
 	virtual int getNumOfWorkingDevices() = 0;
 	virtual int configurateExposure(float exposureTime) = 0; // microsec
+	// Call before start(). "Mono10", "Mono12", "Mono10p", "Mono12p" and "Mono16" deliver CV_16UC1
+	// with the native value range, e.g. 0..4095 for Mono12. The packed "p" formats save USB bandwidth.
+	virtual int configuratePixelFormat(const std::string &pixelFormat) = 0;
+	// Applies configs[serial] to each open camera, all cameras at once; cameras without an entry
+	// are left alone. Use it right after openDevices() or on a recipe change. A grabbing camera is
+	// stopped for the change and restarted; trigger mode and source stay with this library, whatever
+	// a feature file says. Fails on a camera with a capture pending. status[camIdx] is 0 or -1.
+	// The configuration is applied again when a lost camera reconnects.
+	virtual int configurateCameras(const std::map<std::string, CameraConfig> &configs, std::vector<int> &status) = 0;
 	virtual int start() = 0;
 	virtual int stop() = 0;
 	virtual int readyHWTrig(int numOfTrig) = 0;
+	// Returned Mats may share the camera grab buffer instead of holding a copy.
+	// Release them (or clone()) once processed so the buffer can be reused. A shared Mat holds its
+	// grab result, so it stays valid past stop() and past the destruction of the baslerCapture.
+	// A lost camera is reopened in the background once all Mats shared with its grab buffers are
+	// released.
+	// The images that did arrive are returned even when the wait fails, along with
+	// CAPTURE_TIMEOUT or CAPTURE_CANCELLED.
 	virtual int getHWTrigImgs(std::vector<cv::Mat> &imgs) = 0;
 	virtual int ExecuteSWTrig(std::vector<cv::Mat> &imgs) = 0;
+	virtual int setSWTrigMode(int mode) = 0;
+	virtual int setAcquisitionMode(int mode) = 0;
+	virtual int getLatestImages(std::vector<cv::Mat> &imgs) = 0;
 	virtual int getCurrentState() = 0;
 
+	// Same as above, with camera serial, timestamps and frame counters per image.
+	virtual int getHWTrigImgs(std::vector<Frame> &frames) = 0;
+	// Hardware trigger burst grouped per trigger across cameras. A lost frame leaves a gap in its
+	// own set (present[camIdx] false) instead of shifting every later frame. tolerance is in
+	// camera ticks for the timestamp modes and in frames for SYNC_FRAME_NUMBER.
+	// Fails only if a camera delivered no frame at all.
+	virtual int getHWTrigFrameSets(std::vector<FrameSet> &sets, int syncMode, int64_t tolerance) = 0;
+	virtual int ExecuteSWTrig(std::vector<Frame> &frames) = 0;
+	virtual int getLatestImages(std::vector<Frame> &frames) = 0;
+
+	// Hardware trigger streaming for continuous triggering, no re-arming between bursts.
+	// Triggered frames queue up per camera, at most queueSize frames each, until stopHWTrigStream().
+	// When the consumer falls behind, new frames are dropped and counted, see getNumOfDroppedFrames().
+	virtual int startHWTrigStream(int queueSize) = 0;
+	// Takes up to maxFrames queued frames per camera (all of them for maxFrames <= 0), in camera
+	// order, waiting at most timeoutMs in total for cameras with nothing queued. Returns 0 when every
+	// camera delivered, 1 when some had nothing (frames of the others are still returned), -1 on error.
+	// Frames can be fed to a FrameSynchronizer to group them per trigger.
+	virtual int readHWTrigStream(std::vector<Frame> &frames, int maxFrames, int timeoutMs) = 0;
+	// Frames still queued are returned, not discarded.
+	virtual int stopHWTrigStream(std::vector<Frame> &frames) = 0;
+	// Per camera, frames dropped on a full queue since the stream or burst was armed.
+	virtual int getNumOfDroppedFrames(std::vector<int64_t> &numDropped) = 0;
+
+	// How long getHWTrigImgs, ExecuteSWTrig and the asynchronous captures wait for frames
+	// before failing with CAPTURE_TIMEOUT. Default 10000 ms, applies from the next capture.
+	// A capture on all cameras has one deadline, set by the longest timeout among them.
+	virtual int setTimeout(int timeoutMs) = 0;
+	// Wakes every wait for frames armed so far, including asynchronous captures; they fail with
+	// CAPTURE_CANCELLED. A running hardware trigger stream stays cancelled until restarted.
+	// Any thread. stop() and the destructor cancel too.
+	virtual int cancelWaits() = 0;
+
+	// Single camera variants, camIdx follows the order of openDevices().
+	// Each camera has its own lock, so different cameras can be driven from different threads.
+	virtual int readyHWTrig(int camIdx, int numOfTrig) = 0;
+	virtual int getHWTrigImgs(int camIdx, std::vector<cv::Mat> &imgs) = 0;
+	virtual int ExecuteSWTrig(int camIdx, cv::Mat &img) = 0;
+	virtual int getHWTrigImgs(int camIdx, std::vector<Frame> &frames) = 0;
+	virtual int readHWTrigStream(int camIdx, std::vector<Frame> &frames, int maxFrames, int timeoutMs) = 0;
+	virtual int setTimeout(int camIdx, int timeoutMs) = 0;
+	// A camera that drops off the bus is reopened in the background once it is back, with exposure,
+	// pixel format, acquisition mode, trigger source and grab state restored. While it is lost, waits
+	// on it fail with CAPTURE_CANCELLED, except a hardware trigger stream, which resumes.
+	// Returns 1 while lost, 0 when connected, -1 for an unknown camIdx.
+	virtual int isDeviceLost(int camIdx) = 0;
+	// Grab buffers and transfer settings of one camera. A grabbing camera is stopped for the change
+	// and restarted; fails while a capture is pending. Settings not supported by the transport layer
+	// are reported and skipped, with -1 returned. Fields left at -1 keep their earlier value.
+	// Without an explicit maxNumBuffer, readyHWTrig() and startHWTrigStream() raise MaxNumBuffer so
+	// that the whole burst fits while the consumer is busy.
+	virtual int configurateStream(int camIdx, const StreamConfig &config) = 0;
+	virtual int getStreamStatus(int camIdx, StreamStatus &status) = 0;
+	virtual int ExecuteSWTrig(int camIdx, Frame &frame) = 0;
+	// Applies from the next frame; call before start() so the frame pool matches the output size.
+	virtual int setDemosaicMode(int camIdx, int mode) = 0;
+	// GRAB_* strategy of one camera; numImages is only used by GRAB_LATEST_IMAGES. A grabbing
+	// camera is restarted for the change, which fails while a capture is pending. Frames counted
+	// by getNumOfDroppedFrames() include the ones overwritten in the frame queue.
+	virtual int setGrabStrategy(int camIdx, int strategy, int numImages) = 0;
+	// Frames are converted and queued on the grab thread. With bOwnThread it is started by this
+	// library, pinned and prioritized as configured, and the frame pool is first written from
+	// there, so its pages are local to the thread's NUMA node. Placement or priority the OS refuses
+	// is reported and the thread runs without it. A grabbing camera is restarted for the change,
+	// which fails while a capture is pending.
+	virtual int setGrabThread(int camIdx, const GrabThreadConfig &config) = 0;
+	// Turns on chunk mode with the given CHUNK_* chunks, 0 turns it off. The values arrive with the
+	// image and are reported in Frame::chunks, so they are exact for the frame and cost no extra
+	// camera access. Chunks the camera lacks are reported and left out, with -1 returned. A grabbing
+	// camera is restarted for the change, which fails while a capture is pending. The chunks are
+	// enabled again when a lost camera reconnects.
+	virtual int setChunks(int camIdx, int chunks) = 0;
+
+	// Non-blocking variants of ExecuteSWTrig(imgs) and getHWTrigImgs(imgs) with the same result
+	// layout. They return once the cameras are armed (and triggered); the frames are collected
+	// by one dispatcher thread per baslerCapture, so no thread waits per outstanding capture.
+	// The callback variants return -1 without calling back if the capture cannot start.
+	// While a capture is outstanding, other captures on its cameras fail.
+	virtual std::future<CaptureResult> ExecuteSWTrigAsync() = 0;
+	virtual int ExecuteSWTrigAsync(const CaptureCallback &callback) = 0;
+	virtual std::future<CaptureResult> getHWTrigImgsAsync() = 0;
+	virtual int getHWTrigImgsAsync(const CaptureCallback &callback) = 0;
+
+	// Push delivery of every grabbed frame of camera camIdx, whether or not a capture asked for it.
+	// Returns a subscription id, or -1. Threading contract:
+	// - Callbacks of different cameras run concurrently. Callbacks of one subscription never overlap.
+	// - The image shares its buffer with other subscribers and capture results: read it, do not
+	//   write it. Holding it is safe, but the pool then falls back to allocating new frames.
+	// - Exceptions thrown by a callback are caught and logged.
+	// - A frame already in delivery may still reach the callback after unsubscribe() returns.
+	// - subscribe() / unsubscribe() may be called from any thread, including from a callback.
+	virtual int subscribe(int camIdx, const FrameCallback &callback, int dispatch) = 0;
+	virtual int unsubscribe(int subscriptionId) = 0;
+
 };
 
 std::shared_ptr<baslerCaptureItf> createBaslerCapture();
@@ -0,0 +1,387 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#include "bayerDemosaic.h"
+
+/****************************************
+
+common
+
+*****************************************/
+// per pattern and row parity: green sits on even columns / the row's other colour is red
+static const bool g_greenFirst[4][2] = { { false, true }, { false, true }, { true, false }, { true, false } };
+static const bool g_ownIsRed[4][2] = { { true, false }, { false, true }, { true, false }, { false, true } };
+
+// rounding average, same as _mm_avg_epu8
+static inline uint8_t avg(uint8_t a, uint8_t b)
+{
+	return (uint8_t)((a + b + 1) >> 1);
+}
+
+// reflect-101 keeps the Bayer phase at the image border
+static inline int reflect(int i, int n)
+{
+	return i < 0 ? -i : (i >= n ? 2 * n - 2 - i : i);
+}
+
+typedef void(*BilinearRowFunc)(const uint8_t *up, const uint8_t *cur, const uint8_t *dn, int width, bool greenFirst, bool ownIsRed, uint8_t *pOut);
+typedef void(*SuperpixelRowFunc)(const uint8_t *row0, const uint8_t *row1, int outWidth, bool greenOnDiagonal, bool ownIsRed, uint8_t *pOut);
+
+/****************************************
+
+scalar kernels
+
+*****************************************/
+// At a green site: G = centre, own colour = horizontal, other colour = vertical.
+// Elsewhere: own colour = centre, G = average of the four neighbours, other colour = diagonals.
+static void bilinearRowScalar(const uint8_t *up, const uint8_t *cur, const uint8_t *dn, int width, bool greenFirst, bool ownIsRed, uint8_t *pOut, int xBegin, int xEnd)
+{
+	for (int x = xBegin; x < xEnd; ++x)
+	{
+		int xl = reflect(x - 1, width);
+		int xr = reflect(x + 1, width);
+		uint8_t c = cur[x];
+		uint8_t h = avg(cur[xl], cur[xr]);
+		uint8_t v = avg(up[x], dn[x]);
+		uint8_t d = avg(avg(up[xl], up[xr]), avg(dn[xl], dn[xr]));
+
+		uint8_t own, g, other;
+		if (((x & 1) == 0) == greenFirst)
+		{
+			g = c;
+			own = h;
+			other = v;
+		}
+		else
+		{
+			own = c;
+			g = avg(h, v);
+			other = d;
+		}
+		uint8_t *p = pOut + 3 * x;
+		p[0] = ownIsRed ? other : own;
+		p[1] = g;
+		p[2] = ownIsRed ? own : other;
+	}
+}
+
+static void bilinearRowScalar(const uint8_t *up, const uint8_t *cur, const uint8_t *dn, int width, bool greenFirst, bool ownIsRed, uint8_t *pOut)
+{
+	bilinearRowScalar(up, cur, dn, width, greenFirst, ownIsRed, pOut, 0, width);
+}
+
+static void superpixelRowScalar(const uint8_t *row0, const uint8_t *row1, int outWidth, bool greenOnDiagonal, bool ownIsRed, uint8_t *pOut, int jBegin)
+{
+	for (int j = jBegin; j < outWidth; ++j)
+	{
+		uint8_t p00 = row0[2 * j];
+		uint8_t p01 = row0[2 * j + 1];
+		uint8_t p10 = row1[2 * j];
+		uint8_t p11 = row1[2 * j + 1];
+
+		uint8_t g = greenOnDiagonal ? avg(p00, p11) : avg(p01, p10);
+		uint8_t first = greenOnDiagonal ? p01 : p00;  // colour of row 0
+		uint8_t second = greenOnDiagonal ? p10 : p11; // colour of row 1
+		uint8_t *p = pOut + 3 * j;
+		p[0] = ownIsRed ? second : first;
+		p[1] = g;
+		p[2] = ownIsRed ? first : second;
+	}
+}
+
+static void superpixelRowScalar(const uint8_t *row0, const uint8_t *row1, int outWidth, bool greenOnDiagonal, bool ownIsRed, uint8_t *pOut)
+{
+	superpixelRowScalar(row0, row1, outWidth, greenOnDiagonal, ownIsRed, pOut, 0);
+}
+
+#if defined(SIMD_X86)
+/****************************************
+
+SSE4.1 kernels
+
+*****************************************/
+// 16 planar B, G, R bytes to 48 interleaved BGR bytes
+TARGET_SSE41 static inline void storeBGR(uint8_t *pOut, __m128i b, __m128i g, __m128i r)
+{
+	const __m128i b0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+	const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+	const __m128i r0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+	const __m128i b1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+	const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+	const __m128i r1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+	const __m128i b2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+	const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+	const __m128i r2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+	__m128i out0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(r, r0));
+	__m128i out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(r, r1));
+	__m128i out2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(r, r2));
+	_mm_storeu_si128((__m128i*)pOut, out0);
+	_mm_storeu_si128((__m128i*)(pOut + 16), out1);
+	_mm_storeu_si128((__m128i*)(pOut + 32), out2);
+}
+
+// interior columns from x in blocks of 16, returns the first column left undone
+TARGET_SSE41 static inline int bilinearBlocksSSE41(const uint8_t *up, const uint8_t *cur, const uint8_t *dn, int width, bool greenFirst, bool ownIsRed, uint8_t *pOut, int x)
+{
+	// x is even, so lane parity equals column parity
+	const __m128i greenMask = greenFirst ? _mm_set1_epi16(0x00FF) : _mm_set1_epi16((short)0xFF00);
+	for (; x + 16 < width; x += 16)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i*)(cur + x));
+		__m128i cl = _mm_loadu_si128((const __m128i*)(cur + x - 1));
+		__m128i cr = _mm_loadu_si128((const __m128i*)(cur + x + 1));
+		__m128i u = _mm_loadu_si128((const __m128i*)(up + x));
+		__m128i ul = _mm_loadu_si128((const __m128i*)(up + x - 1));
+		__m128i ur = _mm_loadu_si128((const __m128i*)(up + x + 1));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dn + x));
+		__m128i dl = _mm_loadu_si128((const __m128i*)(dn + x - 1));
+		__m128i dr = _mm_loadu_si128((const __m128i*)(dn + x + 1));
+
+		__m128i h = _mm_avg_epu8(cl, cr);
+		__m128i v = _mm_avg_epu8(u, d);
+		__m128i diag = _mm_avg_epu8(_mm_avg_epu8(ul, ur), _mm_avg_epu8(dl, dr));
+		__m128i cross = _mm_avg_epu8(h, v);
+
+		__m128i own = _mm_blendv_epi8(c, h, greenMask);
+		__m128i g = _mm_blendv_epi8(cross, c, greenMask);
+		__m128i other = _mm_blendv_epi8(diag, v, greenMask);
+		if (ownIsRed)
+		{
+			storeBGR(pOut + 3 * x, other, g, own);
+		}
+		else
+		{
+			storeBGR(pOut + 3 * x, own, g, other);
+		}
+	}
+	return x;
+}
+
+TARGET_SSE41 static void bilinearRowSSE41(const uint8_t *up, const uint8_t *cur, const uint8_t *dn, int width, bool greenFirst, bool ownIsRed, uint8_t *pOut)
+{
+	// border columns need reflection, leave them to the scalar code
+	bilinearRowScalar(up, cur, dn, width, greenFirst, ownIsRed, pOut, 0, 2);
+	int x = bilinearBlocksSSE41(up, cur, dn, width, greenFirst, ownIsRed, pOut, 2);
+	bilinearRowScalar(up, cur, dn, width, greenFirst, ownIsRed, pOut, x, width);
+}
+
+// 2x2 cells from column pair j in blocks of 16, returns the first cell left undone
+TARGET_SSE41 static inline int superpixelBlocksSSE41(const uint8_t *row0, const uint8_t *row1, int outWidth, bool greenOnDiagonal, bool ownIsRed, uint8_t *pOut, int j)
+{
+	const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+	for (; j + 16 <= outWidth; j += 16)
+	{
+		__m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + 2 * j));
+		__m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 2 * j + 16));
+		__m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + 2 * j));
+		__m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 2 * j + 16));
+
+		__m128i even0 = _mm_packus_epi16(_mm_and_si128(a0, lowBytes), _mm_and_si128(a1, lowBytes));
+		__m128i odd0 = _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(a1, 8));
+		__m128i even1 = _mm_packus_epi16(_mm_and_si128(b0, lowBytes), _mm_and_si128(b1, lowBytes));
+		__m128i odd1 = _mm_packus_epi16(_mm_srli_epi16(b0, 8), _mm_srli_epi16(b1, 8));
+
+		__m128i g = greenOnDiagonal ? _mm_avg_epu8(even0, odd1) : _mm_avg_epu8(odd0, even1);
+		__m128i first = greenOnDiagonal ? odd0 : even0;
+		__m128i second = greenOnDiagonal ? even1 : odd1;
+		if (ownIsRed)
+		{
+			storeBGR(pOut + 3 * j, second, g, first);
+		}
+		else
+		{
+			storeBGR(pOut + 3 * j, first, g, second);
+		}
+	}
+	return j;
+}
+
+TARGET_SSE41 static void superpixelRowSSE41(const uint8_t *row0, const uint8_t *row1, int outWidth, bool greenOnDiagonal, bool ownIsRed, uint8_t *pOut)
+{
+	int j = superpixelBlocksSSE41(row0, row1, outWidth, greenOnDiagonal, ownIsRed, pOut, 0);
+	superpixelRowScalar(row0, row1, outWidth, greenOnDiagonal, ownIsRed, pOut, j);
+}
+
+/****************************************
+
+AVX2 kernels
+
+*****************************************/
+// 32 planar B, G, R bytes to 96 interleaved BGR bytes
+TARGET_AVX2 static inline void storeBGR(uint8_t *pOut, __m256i b, __m256i g, __m256i r)
+{
+	storeBGR(pOut, _mm256_castsi256_si128(b), _mm256_castsi256_si128(g), _mm256_castsi256_si128(r));
+	storeBGR(pOut + 48, _mm256_extracti128_si256(b, 1), _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(r, 1));
+}
+
+TARGET_AVX2 static void bilinearRowAVX2(const uint8_t *up, const uint8_t *cur, const uint8_t *dn, int width, bool greenFirst, bool ownIsRed, uint8_t *pOut)
+{
+	bilinearRowScalar(up, cur, dn, width, greenFirst, ownIsRed, pOut, 0, 2);
+
+	const __m256i greenMask = greenFirst ? _mm256_set1_epi16(0x00FF) : _mm256_set1_epi16((short)0xFF00);
+	int x = 2;
+	for (; x + 32 < width; x += 32)
+	{
+		__m256i c = _mm256_loadu_si256((const __m256i*)(cur + x));
+		__m256i cl = _mm256_loadu_si256((const __m256i*)(cur + x - 1));
+		__m256i cr = _mm256_loadu_si256((const __m256i*)(cur + x + 1));
+		__m256i u = _mm256_loadu_si256((const __m256i*)(up + x));
+		__m256i ul = _mm256_loadu_si256((const __m256i*)(up + x - 1));
+		__m256i ur = _mm256_loadu_si256((const __m256i*)(up + x + 1));
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dn + x));
+		__m256i dl = _mm256_loadu_si256((const __m256i*)(dn + x - 1));
+		__m256i dr = _mm256_loadu_si256((const __m256i*)(dn + x + 1));
+
+		__m256i h = _mm256_avg_epu8(cl, cr);
+		__m256i v = _mm256_avg_epu8(u, d);
+		__m256i diag = _mm256_avg_epu8(_mm256_avg_epu8(ul, ur), _mm256_avg_epu8(dl, dr));
+		__m256i cross = _mm256_avg_epu8(h, v);
+
+		__m256i own = _mm256_blendv_epi8(c, h, greenMask);
+		__m256i g = _mm256_blendv_epi8(cross, c, greenMask);
+		__m256i other = _mm256_blendv_epi8(diag, v, greenMask);
+		if (ownIsRed)
+		{
+			storeBGR(pOut + 3 * x, other, g, own);
+		}
+		else
+		{
+			storeBGR(pOut + 3 * x, own, g, other);
+		}
+	}
+
+	x = bilinearBlocksSSE41(up, cur, dn, width, greenFirst, ownIsRed, pOut, x);
+	bilinearRowScalar(up, cur, dn, width, greenFirst, ownIsRed, pOut, x, width);
+}
+
+TARGET_AVX2 static void superpixelRowAVX2(const uint8_t *row0, const uint8_t *row1, int outWidth, bool greenOnDiagonal, bool ownIsRed, uint8_t *pOut)
+{
+	const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+	int j = 0;
+	for (; j + 32 <= outWidth; j += 32)
+	{
+		__m256i a0 = _mm256_loadu_si256((const __m256i*)(row0 + 2 * j));
+		__m256i a1 = _mm256_loadu_si256((const __m256i*)(row0 + 2 * j + 32));
+		__m256i b0 = _mm256_loadu_si256((const __m256i*)(row1 + 2 * j));
+		__m256i b1 = _mm256_loadu_si256((const __m256i*)(row1 + 2 * j + 32));
+
+		// packus works per 128 bit lane, the permute restores column order
+		__m256i even0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(a0, lowBytes), _mm256_and_si256(a1, lowBytes)), 0xD8);
+		__m256i odd0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(a0, 8), _mm256_srli_epi16(a1, 8)), 0xD8);
+		__m256i even1 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(b0, lowBytes), _mm256_and_si256(b1, lowBytes)), 0xD8);
+		__m256i odd1 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(b0, 8), _mm256_srli_epi16(b1, 8)), 0xD8);
+
+		__m256i g = greenOnDiagonal ? _mm256_avg_epu8(even0, odd1) : _mm256_avg_epu8(odd0, even1);
+		__m256i first = greenOnDiagonal ? odd0 : even0;
+		__m256i second = greenOnDiagonal ? even1 : odd1;
+		if (ownIsRed)
+		{
+			storeBGR(pOut + 3 * j, second, g, first);
+		}
+		else
+		{
+			storeBGR(pOut + 3 * j, first, g, second);
+		}
+	}
+
+	j = superpixelBlocksSSE41(row0, row1, outWidth, greenOnDiagonal, ownIsRed, pOut, j);
+	superpixelRowScalar(row0, row1, outWidth, greenOnDiagonal, ownIsRed, pOut, j);
+}
+#endif
+
+/****************************************
+
+BayerDemosaic
+
+*****************************************/
+int BayerDemosaic::getBestIsa()
+{
+	return getBestSimdIsa();
+}
+
+int BayerDemosaic::getOutputSize(int mode, int width, int height, int &outWidth, int &outHeight)
+{
+	if (mode == MODE_SUPERPIXEL)
+	{
+		outWidth = width / 2;
+		outHeight = height / 2;
+		return 0;
+	}
+	if (mode == MODE_BILINEAR)
+	{
+		outWidth = width;
+		outHeight = height;
+		return 0;
+	}
+	return -1;
+}
+
+int BayerDemosaic::run(const uint8_t *pSrc, size_t srcStep, int width, int height, int pattern,
+	uint8_t *pDst, size_t dstStep, int mode, int isa)
+{
+	if (pSrc == NULL || pDst == NULL || width < 2 || height < 2 || (width & 1) || (height & 1))
+	{
+		return -1;
+	}
+	if (pattern < PATTERN_RG || pattern > PATTERN_GB)
+	{
+		return -1;
+	}
+	if (isa == ISA_AUTO || isa > getBestIsa())
+	{
+		isa = getBestIsa();
+	}
+
+	if (mode == MODE_BILINEAR)
+	{
+		BilinearRowFunc rowFunc = bilinearRowScalar;
+#if defined(SIMD_X86)
+		if (isa == ISA_AVX2)
+		{
+			rowFunc = bilinearRowAVX2;
+		}
+		else if (isa == ISA_SSE41)
+		{
+			rowFunc = bilinearRowSSE41;
+		}
+#endif
+		for (int y = 0; y < height; ++y)
+		{
+			const uint8_t *up = pSrc + reflect(y - 1, height) * srcStep;
+			const uint8_t *cur = pSrc + y * srcStep;
+			const uint8_t *dn = pSrc + reflect(y + 1, height) * srcStep;
+			rowFunc(up, cur, dn, width, g_greenFirst[pattern][y & 1], g_ownIsRed[pattern][y & 1], pDst + y * dstStep);
+		}
+		return 0;
+	}
+
+	if (mode == MODE_SUPERPIXEL)
+	{
+		SuperpixelRowFunc rowFunc = superpixelRowScalar;
+#if defined(SIMD_X86)
+		if (isa == ISA_AVX2)
+		{
+			rowFunc = superpixelRowAVX2;
+		}
+		else if (isa == ISA_SSE41)
+		{
+			rowFunc = superpixelRowSSE41;
+		}
+#endif
+		bool greenOnDiagonal = g_greenFirst[pattern][0];
+		int outWidth = width / 2;
+		for (int i = 0; i < height / 2; ++i)
+		{
+			const uint8_t *row0 = pSrc + (2 * i) * srcStep;
+			const uint8_t *row1 = pSrc + (2 * i + 1) * srcStep;
+			rowFunc(row0, row1, outWidth, greenOnDiagonal, g_ownIsRed[pattern][0], pDst + i * dstStep);
+		}
+		return 0;
+	}
+
+	return -1;
+}
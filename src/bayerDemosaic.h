@@ -0,0 +1,47 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "simdIsa.h"
+
+/****************************************
+
+BayerDemosaic
+
+Bayer 8 bit to BGR8 (OpenCV channel order) with AVX2 / SSE4.1 kernels and a
+scalar fallback. All kernels produce bit-identical output.
+
+*****************************************/
+class BayerDemosaic
+{
+public:
+	// colour of the top-left 2x2 cell, same naming as the pylon pixel types
+	static const int PATTERN_RG = 0;
+	static const int PATTERN_BG = 1;
+	static const int PATTERN_GR = 2;
+	static const int PATTERN_GB = 3;
+
+	static const int MODE_BILINEAR = 0;   // full resolution
+	static const int MODE_SUPERPIXEL = 1; // one BGR pixel per 2x2 cell, half resolution
+
+	static const int ISA_AUTO = SIMD_ISA_AUTO;
+	static const int ISA_SCALAR = SIMD_ISA_SCALAR;
+	static const int ISA_SSE41 = SIMD_ISA_SSE41;
+	static const int ISA_AVX2 = SIMD_ISA_AVX2;
+
+	// best instruction set supported by this CPU
+	static int getBestIsa();
+
+	static int getOutputSize(int mode, int width, int height, int &outWidth, int &outHeight);
+
+	// pSrc: width x height Bayer image, width and height even.
+	// pDst: BGR8 image of getOutputSize(). Steps are in bytes.
+	// isa above getBestIsa() is clamped. Returns 0 on success, -1 on bad arguments.
+	static int run(const uint8_t *pSrc, size_t srcStep, int width, int height, int pattern,
+		uint8_t *pDst, size_t dstStep, int mode, int isa = ISA_AUTO);
+};
@@ -0,0 +1,137 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#include "frameSynchronizer.h"
+#include <iostream>
+
+FrameSynchronizer::FrameSynchronizer(int numCameras, int syncMode, int64_t tolerance, int maxPending)
+	: m_numCameras(numCameras), m_syncMode(syncMode), m_tolerance(tolerance), m_maxPending(maxPending),
+	m_queues(numCameras), m_bHasReference(numCameras, false), m_reference(numCameras, 0)
+{
+}
+
+void FrameSynchronizer::reset()
+{
+	for (int i = 0; i < m_numCameras; ++i)
+	{
+		m_queues[i].clear();
+		m_bHasReference[i] = false;
+		m_reference[i] = 0;
+	}
+}
+
+// the relative modes count from the first frame of each camera,
+// which assumes the first trigger reached every camera
+int64_t FrameSynchronizer::key(const Frame &frame)
+{
+	int64_t value = 0;
+	if (m_syncMode == baslerCaptureItf::SYNC_FRAME_NUMBER)
+	{
+		// counted on the camera, so a lost frame leaves a gap; imageNumber would close it
+		value = frame.chunks.triggerCounter >= 0 ? frame.chunks.triggerCounter : (int64_t)frame.blockID;
+	}
+	else
+	{
+		value = (int64_t)frame.timestamp;
+	}
+	if (m_syncMode == baslerCaptureItf::SYNC_TIMESTAMP)
+	{
+		return value;
+	}
+
+	if (!m_bHasReference[frame.camIdx])
+	{
+		m_bHasReference[frame.camIdx] = true;
+		m_reference[frame.camIdx] = value;
+	}
+	return value - m_reference[frame.camIdx];
+}
+
+int FrameSynchronizer::push(const Frame &frame)
+{
+	if (frame.camIdx < 0 || frame.camIdx >= m_numCameras)
+	{
+		std::cerr << "FrameSynchronizer: camIdx = " << frame.camIdx << " out of range.\n";
+		return -1;
+	}
+	m_queues[frame.camIdx].push_back(std::make_pair(key(frame), frame));
+	return 0;
+}
+
+// The set is anchored at the smallest queued key. A camera contributes its oldest
+// frame when it is within tolerance of the anchor, older frames never match later sets.
+bool FrameSynchronizer::popSet(bool bFlush, FrameSet &set)
+{
+	int64_t anchor = 0;
+	bool bAnyFrame = false;
+	bool bAllQueued = true;
+	bool bBacklog = false;
+	for (int i = 0; i < m_numCameras; ++i)
+	{
+		if (m_queues[i].empty())
+		{
+			bAllQueued = false;
+			continue;
+		}
+		if (!bAnyFrame || m_queues[i].front().first < anchor)
+		{
+			anchor = m_queues[i].front().first;
+		}
+		bAnyFrame = true;
+		bBacklog = bBacklog || m_queues[i].size() > m_maxPending;
+	}
+	if (!bAnyFrame)
+	{
+		return false;
+	}
+
+	// a camera with nothing queued may still deliver a frame for this set,
+	// unless a frame past the set shows it has moved on
+	if (!bFlush && !bAllQueued && !bBacklog)
+	{
+		return false;
+	}
+
+	set.key = anchor;
+	set.frames.assign(m_numCameras, Frame());
+	set.present.assign(m_numCameras, false);
+	set.complete = true;
+	for (int i = 0; i < m_numCameras; ++i)
+	{
+		if (!m_queues[i].empty() && m_queues[i].front().first - anchor <= m_tolerance)
+		{
+			set.frames[i] = m_queues[i].front().second;
+			set.present[i] = true;
+			m_queues[i].pop_front();
+		}
+		else
+		{
+			set.frames[i].camIdx = i;
+			set.complete = false;
+		}
+	}
+	return true;
+}
+
+int FrameSynchronizer::popSets(std::vector<FrameSet> &sets)
+{
+	FrameSet set;
+	while (popSet(false, set))
+	{
+		sets.push_back(set);
+	}
+	return 0;
+}
+
+int FrameSynchronizer::flush(std::vector<FrameSet> &sets)
+{
+	FrameSet set;
+	while (popSet(true, set))
+	{
+		sets.push_back(set);
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#pragma once
+#include <deque>
+#include <vector>
+#include "baslerCapture.h"
+
+/****************************************
+
+FrameSynchronizer
+
+Groups frames of several cameras into FrameSets by a per-frame key
+(device timestamp or frame counter, see baslerCaptureItf::SYNC_*).
+Frames of one camera must be pushed in grab order. A set is emitted
+once every camera has a frame past it, or a camera has fallen
+maxPending frames behind, so a lost frame only affects its own set.
+
+*****************************************/
+class FrameSynchronizer
+{
+public:
+	static const int DEFAULT_MAX_PENDING = 8;
+
+	// tolerance in key units: camera ticks for timestamps, frames for counters
+	FrameSynchronizer(int numCameras, int syncMode, int64_t tolerance, int maxPending = DEFAULT_MAX_PENDING);
+
+	// frame.camIdx selects the camera. Returns -1 for an unknown camera.
+	int push(const Frame &frame);
+
+	// appends the sets that can no longer change
+	int popSets(std::vector<FrameSet> &sets);
+
+	// appends all remaining sets, e.g. at the end of a burst
+	int flush(std::vector<FrameSet> &sets);
+
+	// forget queued frames and per-camera reference keys
+	void reset();
+
+private:
+	bool popSet(bool bFlush, FrameSet &set);
+	int64_t key(const Frame &frame);
+
+private:
+	int m_numCameras;
+	int m_syncMode;
+	int64_t m_tolerance;
+	int m_maxPending;
+
+	std::vector<std::deque<std::pair<int64_t, Frame> > > m_queues; // per camera: key, frame
+	std::vector<bool> m_bHasReference;
+	std::vector<int64_t> m_reference; // first key per camera, for the relative modes
+};
@@ -0,0 +1,185 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#include "monoUnpack.h"
+
+typedef int(*UnpackRowFunc)(const uint8_t *pSrc, size_t rowBytes, int width, uint16_t *pDst);
+
+/****************************************
+
+scalar kernels
+
+*****************************************/
+// pixel i starts at bit bitDepth * i, it never spans more than two bytes
+static void unpackRowScalar(const uint8_t *pSrc, int bitDepth, int xBegin, int width, uint16_t *pDst)
+{
+	const unsigned mask = (1u << bitDepth) - 1;
+	for (int x = xBegin; x < width; ++x)
+	{
+		size_t bit = (size_t)x * bitDepth;
+		const uint8_t *p = pSrc + (bit >> 3);
+		unsigned word = p[0] | ((unsigned)p[1] << 8);
+		pDst[x] = (uint16_t)((word >> (bit & 7)) & mask);
+	}
+}
+
+#if defined(SIMD_X86)
+/****************************************
+
+SSE4.1 kernels
+
+*****************************************/
+// 8 pixels from 12 bytes: even pixels are the low 12 bits of bytes (3k, 3k+1),
+// odd pixels the high 12 bits of bytes (3k+1, 3k+2)
+TARGET_SSE41 static inline __m128i unpack12p8(__m128i packed)
+{
+	const __m128i gather = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+	const __m128i lowBits = _mm_set1_epi16(0x0FFF);
+	__m128i words = _mm_shuffle_epi8(packed, gather);
+	return _mm_blend_epi16(_mm_and_si128(words, lowBits), _mm_srli_epi16(words, 4), 0xAA);
+}
+
+// 8 pixels from 10 bytes: pixel i sits at bit 2 * (i % 4) of the word at byte 10 * i / 8.
+// The multiply moves it to the top of the word, the shift brings it down without a mask.
+TARGET_SSE41 static inline __m128i unpack10p8(__m128i packed)
+{
+	const __m128i gather = _mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9);
+	const __m128i align = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+	__m128i words = _mm_shuffle_epi8(packed, gather);
+	return _mm_srli_epi16(_mm_mullo_epi16(words, align), 6);
+}
+
+// 16 byte loads, so a block may only start where 16 bytes of the row are left
+TARGET_SSE41 static inline int unpack12pBlocksSSE41(const uint8_t *pSrc, size_t rowBytes, int width, uint16_t *pDst, int x)
+{
+	for (; x + 8 <= width && (size_t)x * 3 / 2 + 16 <= rowBytes; x += 8)
+	{
+		__m128i packed = _mm_loadu_si128((const __m128i*)(pSrc + x * 3 / 2));
+		_mm_storeu_si128((__m128i*)(pDst + x), unpack12p8(packed));
+	}
+	return x;
+}
+
+TARGET_SSE41 static inline int unpack10pBlocksSSE41(const uint8_t *pSrc, size_t rowBytes, int width, uint16_t *pDst, int x)
+{
+	for (; x + 8 <= width && (size_t)x * 5 / 4 + 16 <= rowBytes; x += 8)
+	{
+		__m128i packed = _mm_loadu_si128((const __m128i*)(pSrc + x * 5 / 4));
+		_mm_storeu_si128((__m128i*)(pDst + x), unpack10p8(packed));
+	}
+	return x;
+}
+
+TARGET_SSE41 static int unpack12pRowSSE41(const uint8_t *pSrc, size_t rowBytes, int width, uint16_t *pDst)
+{
+	return unpack12pBlocksSSE41(pSrc, rowBytes, width, pDst, 0);
+}
+
+TARGET_SSE41 static int unpack10pRowSSE41(const uint8_t *pSrc, size_t rowBytes, int width, uint16_t *pDst)
+{
+	return unpack10pBlocksSSE41(pSrc, rowBytes, width, pDst, 0);
+}
+
+/****************************************
+
+AVX2 kernels
+
+*****************************************/
+// two SSE blocks side by side, one per 128 bit lane
+TARGET_AVX2 static inline __m256i loadLanes(const uint8_t *pLow, const uint8_t *pHigh)
+{
+	__m256i low = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)pLow));
+	return _mm256_inserti128_si256(low, _mm_loadu_si128((const __m128i*)pHigh), 1);
+}
+
+TARGET_AVX2 static int unpack12pRowAVX2(const uint8_t *pSrc, size_t rowBytes, int width, uint16_t *pDst)
+{
+	const __m256i gather = _mm256_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+		0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+	const __m256i lowBits = _mm256_set1_epi16(0x0FFF);
+	int x = 0;
+	for (; x + 16 <= width && (size_t)x * 3 / 2 + 28 <= rowBytes; x += 16)
+	{
+		const uint8_t *p = pSrc + x * 3 / 2;
+		__m256i words = _mm256_shuffle_epi8(loadLanes(p, p + 12), gather);
+		__m256i pixels = _mm256_blend_epi16(_mm256_and_si256(words, lowBits), _mm256_srli_epi16(words, 4), 0xAA);
+		_mm256_storeu_si256((__m256i*)(pDst + x), pixels);
+	}
+	return unpack12pBlocksSSE41(pSrc, rowBytes, width, pDst, x);
+}
+
+TARGET_AVX2 static int unpack10pRowAVX2(const uint8_t *pSrc, size_t rowBytes, int width, uint16_t *pDst)
+{
+	const __m256i gather = _mm256_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9,
+		0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9);
+	const __m256i align = _mm256_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1);
+	int x = 0;
+	for (; x + 16 <= width && (size_t)x * 5 / 4 + 26 <= rowBytes; x += 16)
+	{
+		const uint8_t *p = pSrc + x * 5 / 4;
+		__m256i words = _mm256_shuffle_epi8(loadLanes(p, p + 10), gather);
+		_mm256_storeu_si256((__m256i*)(pDst + x), _mm256_srli_epi16(_mm256_mullo_epi16(words, align), 6));
+	}
+	return unpack10pBlocksSSE41(pSrc, rowBytes, width, pDst, x);
+}
+#endif
+
+/****************************************
+
+MonoUnpack
+
+*****************************************/
+size_t MonoUnpack::getPackedRowSize(int width, int bitDepth)
+{
+	return ((size_t)width * bitDepth + 7) / 8;
+}
+
+int MonoUnpack::run(const uint8_t *pSrc, size_t srcStep, int width, int height, int bitDepth,
+	uint16_t *pDst, size_t dstStep, int isa)
+{
+	if (pSrc == NULL || pDst == NULL || width <= 0 || height <= 0)
+	{
+		return -1;
+	}
+	if (bitDepth != 10 && bitDepth != 12)
+	{
+		return -1;
+	}
+	// the camera packs the image as one bit stream, a row ending inside a byte starts the next
+	// row at a bit offset, which the byte aligned rows here cannot express
+	if ((size_t)width * bitDepth % 8 != 0)
+	{
+		return -1;
+	}
+	if (isa == ISA_AUTO || isa > getBestSimdIsa())
+	{
+		isa = getBestSimdIsa();
+	}
+
+	// the scalar kernel below unpacks whatever the vector kernel leaves, the whole row without one
+	UnpackRowFunc rowFunc = NULL;
+#if defined(SIMD_X86)
+	if (isa == ISA_AVX2)
+	{
+		rowFunc = bitDepth == 10 ? unpack10pRowAVX2 : unpack12pRowAVX2;
+	}
+	else if (isa == ISA_SSE41)
+	{
+		rowFunc = bitDepth == 10 ? unpack10pRowSSE41 : unpack12pRowSSE41;
+	}
+#endif
+
+	// the last row of an image may end right at the buffer end, the vector loads must not pass it
+	size_t rowBytes = getPackedRowSize(width, bitDepth);
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t *pSrcRow = pSrc + y * srcStep;
+		uint16_t *pDstRow = (uint16_t *)((uint8_t *)pDst + y * dstStep);
+		int x = rowFunc != NULL ? rowFunc(pSrcRow, rowBytes, width, pDstRow) : 0;
+		unpackRowScalar(pSrcRow, bitDepth, x, width, pDstRow);
+	}
+	return 0;
+}
@@ -0,0 +1,39 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "simdIsa.h"
+
+/****************************************
+
+MonoUnpack
+
+Mono10p / Mono12p (pixels packed LSB first, no gaps) to 16 bit pixels
+with AVX2 / SSE4.1 kernels and a scalar fallback. Values keep their
+native range (0..1023 / 0..4095). All kernels produce bit-identical output.
+
+*****************************************/
+class MonoUnpack
+{
+public:
+	static const int ISA_AUTO = SIMD_ISA_AUTO;
+	static const int ISA_SCALAR = SIMD_ISA_SCALAR;
+	static const int ISA_SSE41 = SIMD_ISA_SSE41;
+	static const int ISA_AVX2 = SIMD_ISA_AVX2;
+
+	// bytes holding one packed row of width pixels
+	static size_t getPackedRowSize(int width, int bitDepth);
+
+	// pSrc: height rows of width packed pixels, bitDepth 10 or 12, each row starts on a byte.
+	// width * bitDepth must be a multiple of 8, i.e. width even for Mono12p and a multiple of 4
+	// for Mono10p, otherwise rows do not start on a byte and -1 is returned.
+	// pDst: width x height 16 bit image. Steps are in bytes.
+	// isa above getBestSimdIsa() is clamped. Returns 0 on success, -1 on bad arguments.
+	static int run(const uint8_t *pSrc, size_t srcStep, int width, int height, int bitDepth,
+		uint16_t *pDst, size_t dstStep, int isa = ISA_AUTO);
+};
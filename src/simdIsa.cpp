@@ -0,0 +1,52 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#include "simdIsa.h"
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int detectIsa()
+{
+#if defined(SIMD_X86)
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool bSSE41 = (info[2] & (1 << 19)) != 0;
+	bool bOSXSave = (info[2] & (1 << 27)) != 0;
+	bool bAVX = (info[2] & (1 << 28)) != 0;
+	bool bAVX2 = false;
+	// the OS has to save the ymm registers as well
+	if (maxLeaf >= 7 && bOSXSave && bAVX && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		bAVX2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool bSSE41 = __builtin_cpu_supports("sse4.1") != 0;
+	bool bAVX2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+	if (bAVX2)
+	{
+		return SIMD_ISA_AVX2;
+	}
+	if (bSSE41)
+	{
+		return SIMD_ISA_SSE41;
+	}
+#endif
+	return SIMD_ISA_SCALAR;
+}
+
+int getBestSimdIsa()
+{
+	static const int s_isa = detectIsa();
+	return s_isa;
+}
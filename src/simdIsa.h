@@ -0,0 +1,37 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#pragma once
+
+/****************************************
+
+simdIsa
+
+Instruction sets the image kernels are built for, ordered so that a
+kernel may run any level up to getBestSimdIsa().
+
+*****************************************/
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// gcc/clang compile the SIMD kernels per function, MSVC needs no flag for intrinsics
+#if defined(__GNUC__)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+static const int SIMD_ISA_AUTO = -1;
+static const int SIMD_ISA_SCALAR = 0;
+static const int SIMD_ISA_SSE41 = 1;
+static const int SIMD_ISA_AVX2 = 2;
+
+// best instruction set supported by this CPU and OS, detected once
+int getBestSimdIsa();
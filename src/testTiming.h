@@ -0,0 +1,19 @@
+// testTiming.h : timing helper shared by the kernel benchmarks.
+//
+
+#pragma once
+#include <chrono>  // for high_resolution_clock
+
+// milliseconds per frame over numOfRuns frames
+template <class F>
+inline double timeIt(int numOfRuns, F func)
+{
+	func(); // warm up caches and page in the output
+	auto t1 = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < numOfRuns; ++i)
+	{
+		func();
+	}
+	auto t2 = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(t2 - t1).count() / numOfRuns;
+}
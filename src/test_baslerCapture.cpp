@@ -5,34 +5,49 @@
 #include <iostream>
 #include <thread>
 #include <chrono>  // for high_resolution_clock
+#include <atomic>
 
+// software trigger by default, the newest frame of free running cameras in continuous mode
+static std::atomic<bool> g_isContinuous(false);
 
 int liveStreamThread(std::shared_ptr<baslerCaptureItf> pCapture, int show_size)
 {
+	std::chrono::steady_clock::time_point lastHostTime;
 	while (pCapture->getCurrentState() == baslerCaptureItf::RUNNING_STATE)
 	{
 		auto starttime = std::chrono::steady_clock::now();
 
 		/***** get images *****/
-		std::vector<cv::Mat> mats;
-		int status = pCapture->ExecuteSWTrig(mats);
-		if (status != 0 && mats.empty())
+		std::vector<Frame> frames;
+		if (g_isContinuous)
 		{
-			continue;
+			pCapture->getLatestImages(frames);
+		}
+		else
+		{
+			pCapture->ExecuteSWTrig(frames);
 		}
 
-		bool isAnyEmopty = false;
-		for (int i = 0; i < mats.size(); ++i)
+		bool isAnyEmopty = frames.empty();
+		for (int i = 0; i < frames.size(); ++i)
 		{
-			if (mats[i].empty())
+			if (frames[i].image.empty())
 			{
 				isAnyEmopty = true;
 			}
 		}
-		if (isAnyEmopty)
+		// getLatestImages() does not wait: no frame yet, or the one already shown
+		if (isAnyEmopty || (g_isContinuous && frames[0].hostTime == lastHostTime))
 		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
 			continue;
 		}
+		lastHostTime = frames[0].hostTime;
+		std::vector<cv::Mat> mats;
+		for (int i = 0; i < frames.size(); ++i)
+		{
+			mats.push_back(frames[i].image);
+		}
 
 		std::vector<cv::Mat> resize_mats;
 		/***** resize *****/
@@ -147,6 +162,11 @@ int main(int argc, char *argv[])
 		pCapture->openDevices(snlist);
 	}
 	pCapture->configurateExposure(exposureTime);
+	for (int i = 0; i < pCapture->getNumOfWorkingDevices(); ++i)
+	{
+		// the exposure printed per frame comes from the camera, not from the setting above
+		pCapture->setChunks(i, baslerCaptureItf::CHUNK_EXPOSURE_TIME | baslerCaptureItf::CHUNK_TIMESTAMP);
+	}
 	pCapture->start();
 
 	/************ service loop ***************/
@@ -156,14 +176,14 @@ int main(int argc, char *argv[])
 	while (1)
 	{
 
-		std::cout << "press k to capture, q to quit" << "\n";
+		std::cout << "press k to capture, c to toggle continuous mode, s for camera status, q to quit" << "\n";
 		std::string action;
 		std::cin >> action;
 
 		if (action == "k")
 		{
-			std::vector<cv::Mat> mats;
-			status = pCapture->ExecuteSWTrig(mats);
+			std::vector<Frame> frames;
+			status = g_isContinuous ? pCapture->getLatestImages(frames) : pCapture->ExecuteSWTrig(frames);
 			if (status != 0)
 			{
 				std::cout << "capture fail\n";
@@ -171,15 +191,39 @@ int main(int argc, char *argv[])
 			else
 			{
 				std::cout << "capture successful\n";
-				for (int i = 0; i < mats.size(); ++i)
+				for (int i = 0; i < frames.size(); ++i)
 				{
+					std::cout << "cam " << frames[i].camSN << " image " << frames[i].imageNumber
+						<< " timestamp " << frames[i].timestamp << " exposure " << frames[i].chunks.exposureTime << "\n";
 					char buf[1024];
 					snprintf(buf, 1024, "%s/cam_%d_%d.bmp", imageSavePath.c_str(), i, counter);
-					cv::imwrite(buf, mats[i]);
+					cv::imwrite(buf, frames[i].image);
 				}
 				counter++;
 			}
 		}
+		else if (action == "c")
+		{
+			bool isContinuous = !g_isContinuous;
+			status = pCapture->setAcquisitionMode(isContinuous ? baslerCaptureItf::ACQ_CONTINUOUS : baslerCaptureItf::ACQ_TRIGGERED);
+			if (status != 0)
+			{
+				std::cout << "fail to change acquisition mode\n";
+			}
+			else
+			{
+				g_isContinuous = isContinuous;
+				std::cout << (isContinuous ? "continuous mode\n" : "software trigger mode\n");
+			}
+		}
+		else if (action == "s")
+		{
+			// unplug a camera and plug it back in, it should show lost and then connected again
+			for (int i = 0; i < pCapture->getNumOfWorkingDevices(); ++i)
+			{
+				std::cout << "cam " << i << (pCapture->isDeviceLost(i) == 1 ? " lost\n" : " connected\n");
+			}
+		}
 		else if (action == "q")
 		{
 			break;
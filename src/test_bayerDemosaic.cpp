@@ -0,0 +1,215 @@
+// test_bayerDemosaic.cpp : checks and times BayerDemosaic on synthetic Bayer frames, no camera needed.
+//
+
+#include <pylon/PylonIncludes.h>
+#include "bayerDemosaic.h"
+#include "testTiming.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+static const char *g_patternNames[] = { "BayerRG8", "BayerBG8", "BayerGR8", "BayerGB8" };
+static const Pylon::EPixelType g_pixelTypes[] = { Pylon::PixelType_BayerRG8, Pylon::PixelType_BayerBG8, Pylon::PixelType_BayerGR8, Pylon::PixelType_BayerGB8 };
+static const char *g_isaNames[] = { "scalar", "SSE4.1", "AVX2" };
+
+// colour at column x, row y of the pattern, as BGR channel index: 0 = B, 1 = G, 2 = R
+static int bayerChannel(int pattern, int x, int y)
+{
+	// top-left 2x2 cell of RG, BG, GR and GB, row by row
+	static const int cells[4][4] = { { 2, 1, 1, 0 }, { 0, 1, 1, 2 }, { 1, 2, 0, 1 }, { 1, 0, 2, 1 } };
+	return cells[pattern][(y & 1) * 2 + (x & 1)];
+}
+
+// scene to mosaic: a constant colour, or planes linear in x and y with even slopes, on which
+// bilinear interpolation is exact away from the border
+static int sceneValue(bool bConstant, int channel, int x, int y)
+{
+	static const int constant[3] = { 30, 120, 220 };
+	static const int offset[3] = { 4, 20, 60 };
+	static const int slopeX[3] = { 2, 0, 2 };
+	static const int slopeY[3] = { 0, 2, 2 };
+	return bConstant ? constant[channel] : offset[channel] + slopeX[channel] * x + slopeY[channel] * y;
+}
+
+// mosaics the scene on its own and checks the reconstructed colours, independent of the scalar kernel
+static int checkScene(int pattern, int mode, int isa, bool bConstant)
+{
+	const int width = 64;
+	const int height = 16;
+	size_t srcStep = width + 16;
+	std::vector<uint8_t> src(srcStep * height);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			src[y * srcStep + x] = (uint8_t)sceneValue(bConstant, bayerChannel(pattern, x, y), x, y);
+		}
+	}
+	int outWidth = 0;
+	int outHeight = 0;
+	BayerDemosaic::getOutputSize(mode, width, height, outWidth, outHeight);
+	std::vector<uint8_t> out(outWidth * outHeight * 3);
+	BayerDemosaic::run(src.data(), srcStep, width, height, pattern, out.data(), outWidth * 3, mode, isa);
+
+	int numOfErrors = 0;
+	for (int y = 0; y < outHeight; ++y)
+	{
+		for (int x = 0; x < outWidth; ++x)
+		{
+			int expected[3] = { 0, 0, 0 };
+			if (mode == BayerDemosaic::MODE_BILINEAR)
+			{
+				// reflection at the border bends the planes
+				if (!bConstant && (x == 0 || y == 0 || x == width - 1 || y == height - 1))
+				{
+					continue;
+				}
+				for (int c = 0; c < 3; ++c)
+				{
+					expected[c] = sceneValue(bConstant, c, x, y);
+				}
+			}
+			else
+			{
+				// the cell's red and blue samples, the rounded mean of its two greens
+				int greenSum = 0;
+				for (int i = 0; i < 4; ++i)
+				{
+					int cx = 2 * x + (i & 1);
+					int cy = 2 * y + (i >> 1);
+					int c = bayerChannel(pattern, cx, cy);
+					int value = sceneValue(bConstant, c, cx, cy);
+					if (c == 1)
+					{
+						greenSum += value;
+					}
+					else
+					{
+						expected[c] = value;
+					}
+				}
+				expected[1] = (greenSum + 1) >> 1;
+			}
+			const uint8_t *p = out.data() + (y * outWidth + x) * 3;
+			if (p[0] != expected[0] || p[1] != expected[1] || p[2] != expected[2])
+			{
+				numOfErrors++;
+			}
+		}
+	}
+	return numOfErrors;
+}
+
+int main(int argc, char *argv[])
+{
+	int width = 1280;
+	int height = 1024;
+	int numOfRuns = 100;
+
+	// handling para
+	if (argc > 2)
+	{
+		width = atoi(argv[1]) & ~1;
+		height = atoi(argv[2]) & ~1;
+	}
+	if (argc > 3)
+	{
+		numOfRuns = atoi(argv[3]);
+	}
+	std::cout << "frame " << width << "x" << height << ", runs = " << numOfRuns << "\n";
+	std::cout << "best isa = " << g_isaNames[BayerDemosaic::getBestIsa()] << "\n";
+
+	// noise exercises every code path, a wider step than width checks the stride handling
+	size_t srcStep = width + 16;
+	std::vector<uint8_t> src(srcStep * height);
+	srand(1);
+	for (size_t i = 0; i < src.size(); ++i)
+	{
+		src[i] = (uint8_t)(rand() & 0xFF);
+	}
+
+	/****** correctness: every isa must match the scalar kernel **********/
+	int numOfErrors = 0;
+	const int modes[] = { BayerDemosaic::MODE_BILINEAR, BayerDemosaic::MODE_SUPERPIXEL };
+	for (int m = 0; m < 2; ++m)
+	{
+		int outWidth = 0;
+		int outHeight = 0;
+		BayerDemosaic::getOutputSize(modes[m], width, height, outWidth, outHeight);
+		size_t dstStep = outWidth * 3;
+		std::vector<uint8_t> ref(dstStep * outHeight);
+		std::vector<uint8_t> out(dstStep * outHeight);
+		for (int pattern = 0; pattern < 4; ++pattern)
+		{
+			BayerDemosaic::run(src.data(), srcStep, width, height, pattern, ref.data(), dstStep, modes[m], BayerDemosaic::ISA_SCALAR);
+			for (int isa = BayerDemosaic::ISA_SSE41; isa <= BayerDemosaic::getBestIsa(); ++isa)
+			{
+				memset(out.data(), 0, out.size());
+				BayerDemosaic::run(src.data(), srcStep, width, height, pattern, out.data(), dstStep, modes[m], isa);
+				if (memcmp(ref.data(), out.data(), out.size()) != 0)
+				{
+					std::cerr << "mismatch: " << g_patternNames[pattern] << " mode " << modes[m] << " " << g_isaNames[isa] << "\n";
+					numOfErrors++;
+				}
+			}
+		}
+	}
+	std::cout << (numOfErrors == 0 ? "all kernels bit-exact\n" : "kernels differ\n");
+
+	/****** correctness: colours and phase of every pattern against a mosaicked scene **********/
+	int numOfSceneErrors = 0;
+	for (int m = 0; m < 2; ++m)
+	{
+		for (int pattern = 0; pattern < 4; ++pattern)
+		{
+			for (int isa = BayerDemosaic::ISA_SCALAR; isa <= BayerDemosaic::getBestIsa(); ++isa)
+			{
+				for (int bConstant = 0; bConstant < 2; ++bConstant)
+				{
+					if (checkScene(pattern, modes[m], isa, bConstant != 0) != 0)
+					{
+						std::cerr << "wrong colours: " << g_patternNames[pattern] << " mode " << modes[m] << " " << g_isaNames[isa]
+							<< (bConstant ? " constant\n" : " gradient\n");
+						numOfSceneErrors++;
+					}
+				}
+			}
+		}
+	}
+	std::cout << (numOfSceneErrors == 0 ? "all patterns reconstruct the scene\n" : "patterns reconstruct wrong colours\n");
+	numOfErrors += numOfSceneErrors;
+
+	/****** throughput **********/
+	std::vector<uint8_t> dst(width * height * 3);
+	for (int isa = BayerDemosaic::ISA_SCALAR; isa <= BayerDemosaic::getBestIsa(); ++isa)
+	{
+		double msBilinear = timeIt(numOfRuns, [&]() {
+			BayerDemosaic::run(src.data(), srcStep, width, height, BayerDemosaic::PATTERN_RG, dst.data(), width * 3, BayerDemosaic::MODE_BILINEAR, isa);
+		});
+		double msSuperpixel = timeIt(numOfRuns, [&]() {
+			BayerDemosaic::run(src.data(), srcStep, width, height, BayerDemosaic::PATTERN_RG, dst.data(), (width / 2) * 3, BayerDemosaic::MODE_SUPERPIXEL, isa);
+		});
+		std::cout << g_isaNames[isa] << ": bilinear " << msBilinear << " ms, superpixel " << msSuperpixel << " ms\n";
+	}
+
+	Pylon::PylonInitialize();
+	try
+	{
+		Pylon::CImageFormatConverter converter;
+		converter.OutputPixelFormat = Pylon::PixelType_BGR8packed;
+		double msPylon = timeIt(numOfRuns, [&]() {
+			converter.Convert(dst.data(), dst.size(), src.data(), srcStep * height, g_pixelTypes[BayerDemosaic::PATTERN_RG],
+				width, height, srcStep - width, Pylon::ImageOrientation_TopDown);
+		});
+		std::cout << "pylon CImageFormatConverter: " << msPylon << " ms\n";
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cerr << "catch at CImageFormatConverter: " << e.GetDescription() << "\n";
+	}
+	Pylon::PylonTerminate();
+
+	return numOfErrors == 0 ? 0 : -1;
+}
@@ -0,0 +1,172 @@
+// test_frameSynchronizer.cpp : feeds synthetic timestamped frames to FrameSynchronizer, no camera needed.
+//
+
+#include "frameSynchronizer.h"
+#include <iostream>
+#include <cstdlib>
+
+static int g_numOfErrors = 0;
+
+static void check(bool bOk, const char *what)
+{
+	std::cout << (bOk ? "  ok   " : "  FAIL ") << what << "\n";
+	if (!bOk)
+	{
+		g_numOfErrors++;
+	}
+}
+
+// one frame per trigger and camera: trigger period 10 ms, camera clocks in ns with a
+// per camera offset and +-jitter, device counters (block id) starting at a per camera value
+static std::vector<Frame> makeBurst(int camIdx, int numOfTrig, uint64_t clockOffset, int64_t jitter, int64_t firstBlockID)
+{
+	std::vector<Frame> frames;
+	for (int i = 0; i < numOfTrig; ++i)
+	{
+		Frame frame;
+		frame.camIdx = camIdx;
+		frame.timestamp = clockOffset + (uint64_t)i * 10000000 + (jitter > 0 ? rand() % (2 * jitter + 1) : 0);
+		frame.blockID = firstBlockID + i;
+		frame.imageNumber = i;
+		frames.push_back(frame);
+	}
+	return frames;
+}
+
+// the host counts the frames it receives, so imageNumber has no gap where a frame was lost
+static std::vector<Frame> dropFrame(std::vector<Frame> frames, int idx)
+{
+	frames.erase(frames.begin() + idx);
+	for (int i = idx; i < frames.size(); ++i)
+	{
+		frames[i].imageNumber--;
+	}
+	return frames;
+}
+
+static std::vector<Frame> withTriggerCounter(std::vector<Frame> frames, int64_t firstCount)
+{
+	for (int i = 0; i < frames.size(); ++i)
+	{
+		frames[i].chunks.triggerCounter = firstCount + (int64_t)frames[i].blockID;
+		frames[i].blockID = 0;
+	}
+	return frames;
+}
+
+static std::vector<FrameSet> synchronize(const std::vector<std::vector<Frame> > &bursts, int syncMode, int64_t tolerance)
+{
+	FrameSynchronizer synchronizer((int)bursts.size(), syncMode, tolerance);
+	for (int i = 0; i < bursts.size(); ++i)
+	{
+		for (int j = 0; j < bursts[i].size(); ++j)
+		{
+			synchronizer.push(bursts[i][j]);
+		}
+	}
+	std::vector<FrameSet> sets;
+	synchronizer.flush(sets);
+	return sets;
+}
+
+static int numOfComplete(const std::vector<FrameSet> &sets)
+{
+	int num = 0;
+	for (int i = 0; i < sets.size(); ++i)
+	{
+		num += sets[i].complete ? 1 : 0;
+	}
+	return num;
+}
+
+int main(int argc, char *argv[])
+{
+	const int numOfTrig = 100;
+	const int64_t jitter = 50000;     // 50 us
+	const int64_t tolerance = 200000; // 200 us
+	srand(1);
+
+	std::cout << "shared clock, no drops\n";
+	{
+		std::vector<std::vector<Frame> > bursts;
+		for (int c = 0; c < 3; ++c)
+		{
+			bursts.push_back(makeBurst(c, numOfTrig, 1000000000, jitter, 0));
+		}
+		std::vector<FrameSet> sets = synchronize(bursts, baslerCaptureItf::SYNC_TIMESTAMP, tolerance);
+		check(sets.size() == numOfTrig, "one set per trigger");
+		check(numOfComplete(sets) == numOfTrig, "all sets complete");
+	}
+
+	std::cout << "shared clock, camera 1 drops trigger 10, camera 2 drops trigger 50\n";
+	{
+		std::vector<std::vector<Frame> > bursts;
+		bursts.push_back(makeBurst(0, numOfTrig, 1000000000, jitter, 0));
+		bursts.push_back(dropFrame(makeBurst(1, numOfTrig, 1000000000, jitter, 0), 10));
+		bursts.push_back(dropFrame(makeBurst(2, numOfTrig, 1000000000, jitter, 0), 50));
+		std::vector<FrameSet> sets = synchronize(bursts, baslerCaptureItf::SYNC_TIMESTAMP, tolerance);
+		check(sets.size() == numOfTrig, "one set per trigger");
+		check(numOfComplete(sets) == numOfTrig - 2, "only the two sets with a drop are incomplete");
+		check(!sets[10].present[1] && sets[10].present[0] && sets[10].present[2], "set 10 misses camera 1 only");
+		check(!sets[50].present[2] && sets[50].present[0] && sets[50].present[1], "set 50 misses camera 2 only");
+		check(sets[99].frames[1].blockID == 99 && sets[99].frames[2].blockID == 99, "later sets stay aligned");
+	}
+
+	std::cout << "independent clocks, relative timestamps, drop after the first trigger\n";
+	{
+		std::vector<std::vector<Frame> > bursts;
+		bursts.push_back(makeBurst(0, numOfTrig, 5000000000ULL, jitter, 0));
+		bursts.push_back(dropFrame(makeBurst(1, numOfTrig, 123456789, jitter, 0), 30));
+		std::vector<FrameSet> sets = synchronize(bursts, baslerCaptureItf::SYNC_RELATIVE_TIMESTAMP, tolerance);
+		check(sets.size() == numOfTrig, "one set per trigger");
+		check(numOfComplete(sets) == numOfTrig - 1, "only the set with the drop is incomplete");
+		check(!sets[30].present[1], "set 30 misses camera 1");
+	}
+
+	std::cout << "block ids with different start values, drop in the middle of the burst\n";
+	{
+		std::vector<std::vector<Frame> > bursts;
+		bursts.push_back(makeBurst(0, numOfTrig, 0, 0, 7));
+		bursts.push_back(dropFrame(makeBurst(1, numOfTrig, 0, 0, 1000), 40));
+		std::vector<FrameSet> sets = synchronize(bursts, baslerCaptureItf::SYNC_FRAME_NUMBER, 0);
+		check(sets.size() == numOfTrig, "one set per trigger");
+		check(!sets[40].present[1] && numOfComplete(sets) == numOfTrig - 1, "set 40 misses camera 1");
+		check(sets[99].frames[0].blockID == 7 + 99 && sets[99].frames[1].blockID == 1000 + 99, "later sets stay aligned");
+	}
+
+	std::cout << "trigger counters, drops in the middle of the burst\n";
+	{
+		std::vector<std::vector<Frame> > bursts;
+		bursts.push_back(withTriggerCounter(makeBurst(0, numOfTrig, 0, 0, 0), 500));
+		bursts.push_back(withTriggerCounter(dropFrame(dropFrame(makeBurst(1, numOfTrig, 0, 0, 0), 60), 20), 3));
+		std::vector<FrameSet> sets = synchronize(bursts, baslerCaptureItf::SYNC_FRAME_NUMBER, 0);
+		check(sets.size() == numOfTrig, "one set per trigger");
+		check(!sets[20].present[1] && !sets[60].present[1] && numOfComplete(sets) == numOfTrig - 2, "sets 20 and 60 miss camera 1");
+		check(sets[99].frames[1].chunks.triggerCounter == 3 + 99, "later sets stay aligned");
+	}
+
+	std::cout << "streaming: sets come out while frames arrive\n";
+	{
+		FrameSynchronizer synchronizer(2, baslerCaptureItf::SYNC_TIMESTAMP, tolerance);
+		std::vector<Frame> cam0 = makeBurst(0, numOfTrig, 0, jitter, 0);
+		std::vector<Frame> cam1 = dropFrame(makeBurst(1, numOfTrig, 0, jitter, 0), 20);
+		std::vector<FrameSet> sets;
+		int numOfPopped = 0;
+		for (int i = 0; i < numOfTrig; ++i)
+		{
+			synchronizer.push(cam0[i]);
+			if (i < cam1.size())
+			{
+				synchronizer.push(cam1[i]);
+			}
+			synchronizer.popSets(sets);
+			numOfPopped = (int)sets.size();
+		}
+		check(numOfPopped >= numOfTrig - 2, "sets are emitted before the end of the burst");
+		synchronizer.flush(sets);
+		check(sets.size() == numOfTrig && !sets[20].present[1], "flush completes the burst");
+	}
+
+	std::cout << (g_numOfErrors == 0 ? "all checks passed\n" : "checks failed\n");
+	return g_numOfErrors == 0 ? 0 : -1;
+}
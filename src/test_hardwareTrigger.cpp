@@ -31,7 +31,7 @@ int main(int argc, char *argv[])
 	while (1)
 	{
 
-		std::cout << "press k to capture, q to quit" << "\n";
+		std::cout << "press k to capture, s to stream for 10 s, q to quit" << "\n";
 		std::string action;
 		std::cin >> action;
 
@@ -39,10 +39,13 @@ int main(int argc, char *argv[])
 		{
             pCapture->readyHWTrig(45);
             
-			std::vector<cv::Mat> mats;
-            // hardware trigger , not complete
-           
-            status = pCapture->getHWTrigImgs(mats);
+			// frames are collected in the background, the caller is free until get()
+			std::future<CaptureResult> capture = pCapture->getHWTrigImgsAsync();
+			std::cout << "waiting for hardware triggers...\n";
+
+			CaptureResult result = capture.get();
+			std::vector<cv::Mat> mats = result.imgs;
+			status = result.status;
 			if (status != 0)
 			{
 				std::cout << "capture fail\n";
@@ -59,6 +62,33 @@ int main(int argc, char *argv[])
 				counter++;
 			}
 		}
+		else if (action == "s")
+		{
+			// triggers keep coming in while the frames are read, nothing is re-armed
+			pCapture->startHWTrigStream(64);
+			int numOfFrames = 0;
+			auto endtime = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+			while (std::chrono::steady_clock::now() < endtime)
+			{
+				std::vector<Frame> frames;
+				pCapture->readHWTrigStream(frames, 0, 100);
+				numOfFrames += (int)frames.size();
+			}
+			std::vector<Frame> frames;
+			pCapture->stopHWTrigStream(frames);
+			numOfFrames += (int)frames.size();
+
+			std::vector<int64_t> numDropped;
+			pCapture->getNumOfDroppedFrames(numDropped);
+			std::cout << "streamed " << numOfFrames << " frames\n";
+			for (int i = 0; i < numDropped.size(); ++i)
+			{
+				StreamStatus status;
+				pCapture->getStreamStatus(i, status);
+				std::cout << "cam " << i << " dropped " << numDropped[i] << ", buffers " << status.maxNumBuffer
+					<< ", buffer underruns " << status.numBufferUnderruns << "\n";
+			}
+		}
 		else if (action == "q")
 		{
 			break;
@@ -0,0 +1,141 @@
+// test_monoUnpack.cpp : checks and times MonoUnpack on synthetic Mono10p / Mono12p frames, no camera needed.
+//
+
+#include <pylon/PylonIncludes.h>
+#include "monoUnpack.h"
+#include "testTiming.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+
+static const char *g_isaNames[] = { "scalar", "SSE4.1", "AVX2" };
+
+// packs pixels bit by bit, independent of the kernels under test
+static void packFrame(const std::vector<uint16_t> &pixels, int width, int height, int bitDepth, size_t step, std::vector<uint8_t> &packed)
+{
+	packed.assign(step * height, 0);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			unsigned value = pixels[y * width + x];
+			size_t bit = (size_t)x * bitDepth;
+			for (int b = 0; b < bitDepth; ++b)
+			{
+				if ((value >> b) & 1)
+				{
+					packed[y * step + ((bit + b) >> 3)] |= (uint8_t)(1 << ((bit + b) & 7));
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int width = 1280;
+	int height = 1024;
+	int numOfRuns = 100;
+
+	// handling para
+	if (argc > 2)
+	{
+		width = atoi(argv[1]);
+		height = atoi(argv[2]);
+	}
+	if (argc > 3)
+	{
+		numOfRuns = atoi(argv[3]);
+	}
+	std::cout << "frame " << width << "x" << height << ", runs = " << numOfRuns << "\n";
+	std::cout << "best isa = " << g_isaNames[getBestSimdIsa()] << "\n";
+
+	Pylon::PylonInitialize();
+	int numOfErrors = 0;
+	const int bitDepths[] = { 10, 12 };
+	for (int d = 0; d < 2; ++d)
+	{
+		int bitDepth = bitDepths[d];
+		std::vector<uint16_t> pixels(width * height);
+		srand(1);
+		for (size_t i = 0; i < pixels.size(); ++i)
+		{
+			pixels[i] = (uint16_t)(rand() & ((1 << bitDepth) - 1));
+		}
+
+		/****** correctness, also on widths that leave a scalar tail **********/
+		const int testWidths[] = { width, 4, 12, 20, 36, 100 };
+		for (int w = 0; w < 6; ++w)
+		{
+			int testWidth = testWidths[w];
+			int testHeight = testWidth == width ? height : 3;
+			std::vector<uint16_t> ref(testWidth * testHeight);
+			for (int y = 0; y < testHeight; ++y)
+			{
+				for (int x = 0; x < testWidth; ++x)
+				{
+					ref[y * testWidth + x] = pixels[(y * testWidth + x) % pixels.size()];
+				}
+			}
+			size_t step = MonoUnpack::getPackedRowSize(testWidth, bitDepth);
+			std::vector<uint8_t> packed;
+			packFrame(ref, testWidth, testHeight, bitDepth, step, packed);
+			for (int isa = MonoUnpack::ISA_SCALAR; isa <= getBestSimdIsa(); ++isa)
+			{
+				std::vector<uint16_t> out(ref.size(), 0xFFFF);
+				int status = MonoUnpack::run(packed.data(), step, testWidth, testHeight, bitDepth, out.data(), testWidth * sizeof(uint16_t), isa);
+				if (status != 0 || out != ref)
+				{
+					std::cerr << "mismatch: Mono" << bitDepth << "p width " << testWidth << " " << g_isaNames[isa] << "\n";
+					numOfErrors++;
+				}
+			}
+		}
+
+		/****** rows that would end inside a byte are rejected **********/
+		{
+			std::vector<uint8_t> packed(64, 0);
+			std::vector<uint16_t> out(7 * 2);
+			if (MonoUnpack::run(packed.data(), MonoUnpack::getPackedRowSize(7, bitDepth), 7, 2, bitDepth, out.data(), 7 * sizeof(uint16_t)) != -1)
+			{
+				std::cerr << "Mono" << bitDepth << "p width 7 is not rejected\n";
+				numOfErrors++;
+			}
+		}
+
+		/****** throughput **********/
+		size_t step = MonoUnpack::getPackedRowSize(width, bitDepth);
+		std::vector<uint8_t> packed;
+		packFrame(pixels, width, height, bitDepth, step, packed);
+		std::vector<uint16_t> out(width * height);
+		std::cout << "Mono" << bitDepth << "p, " << packed.size() << " bytes vs " << out.size() * sizeof(uint16_t) << " bytes as Mono16\n";
+		for (int isa = MonoUnpack::ISA_SCALAR; isa <= getBestSimdIsa(); ++isa)
+		{
+			double ms = timeIt(numOfRuns, [&]() {
+				MonoUnpack::run(packed.data(), step, width, height, bitDepth, out.data(), width * sizeof(uint16_t), isa);
+			});
+			std::cout << "  " << g_isaNames[isa] << ": " << ms << " ms\n";
+		}
+
+		try
+		{
+			Pylon::CImageFormatConverter converter;
+			converter.OutputPixelFormat = Pylon::PixelType_Mono16;
+			Pylon::EPixelType pixelType = bitDepth == 10 ? Pylon::PixelType_Mono10p : Pylon::PixelType_Mono12p;
+			double ms = timeIt(numOfRuns, [&]() {
+				converter.Convert(out.data(), out.size() * sizeof(uint16_t), packed.data(), packed.size(), pixelType,
+					width, height, 0, Pylon::ImageOrientation_TopDown);
+			});
+			std::cout << "  pylon CImageFormatConverter: " << ms << " ms\n";
+		}
+		catch (GenICam::GenericException &e)
+		{
+			std::cerr << "catch at CImageFormatConverter: " << e.GetDescription() << "\n";
+		}
+	}
+	Pylon::PylonTerminate();
+
+	std::cout << (numOfErrors == 0 ? "all kernels bit-exact\n" : "kernels differ\n");
+	return numOfErrors == 0 ? 0 : -1;
+}
@@ -0,0 +1,124 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#include "threadTuning.h"
+#include <iostream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+int pinCurrentThread(const std::vector<int> &cpus)
+{
+	if (cpus.empty())
+	{
+		return 0;
+	}
+#if defined(_WIN32)
+	DWORD_PTR mask = 0;
+	for (int i = 0; i < cpus.size(); ++i)
+	{
+		if (cpus[i] < 0 || cpus[i] >= 8 * sizeof(DWORD_PTR))
+		{
+			std::cerr << "cpu " << cpus[i] << " out of range.\n";
+			return -1;
+		}
+		mask |= (DWORD_PTR)1 << cpus[i];
+	}
+	if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0)
+	{
+		std::cerr << "SetThreadAffinityMask fail, error " << GetLastError() << ".\n";
+		return -1;
+	}
+	return 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < cpus.size(); ++i)
+	{
+		if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE)
+		{
+			std::cerr << "cpu " << cpus[i] << " out of range.\n";
+			return -1;
+		}
+		CPU_SET(cpus[i], &set);
+	}
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err != 0)
+	{
+		std::cerr << "pthread_setaffinity_np fail, error " << err << ".\n";
+		return -1;
+	}
+	return 0;
+#else
+	std::cerr << "thread affinity not supported on this platform.\n";
+	return -1;
+#endif
+}
+
+int setCurrentThreadPriority(int realtimePriority, int nice)
+{
+#if defined(_WIN32)
+	int priority = THREAD_PRIORITY_NORMAL;
+	if (realtimePriority > 0)
+	{
+		priority = THREAD_PRIORITY_TIME_CRITICAL;
+	}
+	else if (nice <= -10)
+	{
+		priority = THREAD_PRIORITY_HIGHEST;
+	}
+	else if (nice < 0)
+	{
+		priority = THREAD_PRIORITY_ABOVE_NORMAL;
+	}
+	else if (nice >= 10)
+	{
+		priority = THREAD_PRIORITY_LOWEST;
+	}
+	else if (nice > 0)
+	{
+		priority = THREAD_PRIORITY_BELOW_NORMAL;
+	}
+	if (!SetThreadPriority(GetCurrentThread(), priority))
+	{
+		std::cerr << "SetThreadPriority fail, error " << GetLastError() << ".\n";
+		return -1;
+	}
+	return 0;
+#elif defined(__linux__)
+	if (realtimePriority > 0)
+	{
+		sched_param param;
+		param.sched_priority = realtimePriority;
+		int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (err != 0)
+		{
+			std::cerr << "SCHED_FIFO priority " << realtimePriority << " fail, error " << err
+				<< ". It needs CAP_SYS_NICE or an rtprio limit.\n";
+			return -1;
+		}
+		return 0;
+	}
+	// Linux applies nice to a single thread when given its thread id
+	if (nice != 0 && setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice) != 0)
+	{
+		std::cerr << "nice " << nice << " fail, errno " << errno << ".\n";
+		return -1;
+	}
+	return 0;
+#else
+	std::cerr << "thread priority not supported on this platform.\n";
+	return -1;
+#endif
+}
@@ -0,0 +1,24 @@
+/* Copyright (C) ASTRI - All Rights Reserved
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* Written by kuwingto <ronaldku@astri.org>, Jan 2019
+*/
+
+#pragma once
+#include <vector>
+
+/****************************************
+
+threadTuning
+
+Core placement and scheduling of the calling thread. Both return 0, or -1
+when the OS refuses, e.g. for lack of privileges; the thread runs on
+unchanged in that case.
+
+*****************************************/
+// restricts the calling thread to the given cores, an empty list leaves it as it is
+int pinCurrentThread(const std::vector<int> &cpus);
+
+// realtimePriority 1..99 selects SCHED_FIFO (Windows: time critical priority),
+// 0 keeps the normal scheduler with the given nice value -20..19
+int setCurrentThreadPriority(int realtimePriority, int nice);